@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 
 #include <unistd.h>
@@ -15,11 +17,60 @@ using namespace epoll_server;
 
 class Router : public RouterBase {
   std::string HandleRequest(MessagePtr msg) override {
-    SPDLOG_TRACE("Recv:{},{},{},{}", msg->data_len, msg->code, msg->crc32, msg->data);
+    SPDLOG_TRACE("Recv:{},{},{},{}", msg->data_len, msg->code, msg->crc32, msg->payload.ToString());
     return "Ayou";
   }
 };
 
+// A cheap router run in the I/O thread.
+class InlineRouter : public RouterBase {
+  std::string HandleRequest(MessagePtr msg) override {
+    return msg->payload.ToString();
+  }
+};
+
+// Respond the count of bytes in the request. The large response is sended as several chunks
+// to the clients of protocol v2.
+class BulkRouter : public RouterBase {
+  std::string HandleRequest(MessagePtr msg) override {
+    size_t size = std::strtoul(msg->payload.ToString().c_str(), nullptr, 10);
+    return std::string(std::min<size_t>(size, 16 * 1024 * 1024), 'a');
+  }
+};
+
+// Respond the cached config file by sendfile.
+class FileRouter : public FileRouterBase {
+public:
+  FileRouter() : file_(FileRange::Open("conf/config.json")) {
+  }
+
+  FileRangePtr HandleFileRequest(MessagePtr /*msg*/) override {
+    return file_;
+  }
+
+private:
+  FileRangePtr file_;
+};
+
+// Respond three times after 10 ms without blocking the worker thread.
+class AsyncRouter : public AsyncRouterBase {
+public:
+  explicit AsyncRouter(Server* server) : server_(server) {
+  }
+
+  void HandleRequest(MessagePtr msg, ResponderPtr responder) override {
+    std::string data = msg->payload.ToString();
+    server_->CreateTimerAfter(10, [responder, data]() {
+      responder->Send(data + "1");
+      responder->Send(data + "2");
+      responder->Finish(data + "3");
+    });
+  }
+
+private:
+  Server* server_;
+};
+
 // ps -eo pid,ppid,sid,tty,pgrp,comm,stat,cmd | grep -E 'bash|PID|Server'
 // netstat -anp | grep -E 'State|9000'
 
@@ -36,13 +87,25 @@ int main(int argc, char* const* argv) {
   });
 
   server.AddRouter(2020, RouterPtr(new Router));
+  server.AddRouter(2021, RouterPtr(new InlineRouter), true);
+  server.AddRouter(2022, RouterPtr(new AsyncRouter(&server)));
+  server.AddRouter(2023, RouterPtr(new BulkRouter));
+  server.AddRouter(2024, RouterPtr(new FileRouter));
 
   std::thread t([&](){
     server.Start();
   });
 
-  server.CreateTimerEvery(10000, []() {
+  server.CreateTimerEvery(10000, [&server]() {
     std::cout << getpid() << ": Timer 10s." << std::endl;
+
+    if (CONFIG.spin_poll_us > 0) {
+      for (size_t i = 0; i < server.event_loop_count(); ++i) {
+        const EventLoop& event_loop = server.event_loop(i);
+        SPDLOG_INFO("Event loop {}: {} spin hits, {} wasted spins.", i, event_loop.spin_hits(),
+                    event_loop.wasted_spins());
+      }
+    }
   });
 
   sleep(100);
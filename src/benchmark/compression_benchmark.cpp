@@ -0,0 +1,121 @@
+// Measure the LZ4 compression of v2 response chunks: the bytes on the wire and the CPU time per
+// message across payload sizes. The JSON payloads are built by JsonToString like the business
+// responses. The random payloads are not compressible and show the cost of trying.
+// Every payload is checked by decompressing it first.
+//
+// Usage: ./compression_benchmark [bytes_per_run]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "epoll_server/json_helper.h"
+#include "epoll_server/lz4.h"
+#include "epoll_server/message.h"
+
+using namespace epoll_server;
+
+static std::string MakeJson(size_t size) {
+  Json::Value json;
+  json["code"] = 0;
+  json["message"] = "OK";
+
+  std::string str;
+  for (int i = 0; str.size() < size; ++i) {
+    Json::Value item;
+    item["id"] = 100000 + i;
+    item["name"] = "user" + std::to_string(i);
+    item["email"] = "user" + std::to_string(i) + "@example.com";
+    item["score"] = (i * 7919) % 1000;
+    item["active"] = i % 3 != 0;
+    item["tags"].append("tag" + std::to_string(i % 5));
+    item["tags"].append("group" + std::to_string(i % 7));
+    json["items"].append(item);
+
+    if (i % 16 == 0) {
+      JsonToString(json, &str);
+    }
+  }
+
+  JsonToString(json, &str);
+  str.resize(size);
+  return str;
+}
+
+static std::string MakeRandom(size_t size) {
+  std::string data(size, 0);
+  uint32_t seed = 2020;
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<char>(seed >> 16);
+  }
+
+  return data;
+}
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool Run(const char* name, const std::string& data, size_t total) {
+  std::vector<char> compressed(lz4::CompressBound(data.size()));
+  std::string decompressed(data.size(), 0);
+
+  size_t compressed_len = lz4::Compress(data.data(), data.size(), compressed.data(),
+                                        compressed.size());
+  if (compressed_len == 0 ||
+      !lz4::Decompress(compressed.data(), compressed_len, &decompressed[0], data.size()) ||
+      decompressed != data) {
+    printf("%s: wrong result of %zu bytes.\n", name, data.size());
+    return false;
+  }
+
+  size_t count = total / data.size() + 1;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; ++i) {
+    compressed_len = lz4::Compress(data.data(), data.size(), compressed.data(), compressed.size());
+  }
+  double compress_seconds = Seconds(start);
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; ++i) {
+    lz4::Decompress(compressed.data(), compressed_len, &decompressed[0], data.size());
+  }
+  double decompress_seconds = Seconds(start);
+
+  // The chunk is sended uncompressed if the compression doesn't save.
+  size_t raw_wire = Message::kV2HeaderLen + data.size();
+  size_t wire = Message::kV2HeaderLen + std::min(4 + compressed_len, data.size());
+
+  printf("%-7s %8zu %10zu %10zu %7.1f%% %12.2f %12.2f %10.0f %10.0f\n", name, data.size(), raw_wire,
+         wire, 100.0 * wire / raw_wire, count * data.size() / compress_seconds / 1e6,
+         count * data.size() / decompress_seconds / 1e6, compress_seconds / count * 1e9,
+         decompress_seconds / count * 1e9);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  size_t total = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64 * 1024 * 1024;
+
+  printf("%-7s %8s %10s %10s %8s %12s %12s %10s %10s\n", "payload", "size", "raw wire",
+         "wire", "ratio", "comp MB/s", "decomp MB/s", "comp ns", "decomp ns");
+
+  const size_t kSizes[] = {64, 256, 1024, 4096, 16384, 32768, 65536};
+  for (size_t size : kSizes) {
+    if (!Run("json", MakeJson(size), total)) {
+      return 1;
+    }
+  }
+
+  for (size_t size : kSizes) {
+    if (!Run("random", MakeRandom(size), total)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+// Measure the resident memory per idle connection, including its slot in the connection table.
+// Every connection is taken from the pool like an accepted one, serves one request and its
+// response over a socket pair, and then waits idle. Each count is measured in a child process,
+// so the memory of the previous count doesn't count.
+//
+// Usage: ./connection_memory_benchmark [counts...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "epoll_server/buffer_pool.h"
+#include "epoll_server/connection.h"
+#include "epoll_server/connection_pool.h"
+#include "epoll_server/connection_table.h"
+#include "epoll_server/crc32.h"
+#include "epoll_server/message.h"
+#include "epoll_server/utils.h"
+
+using namespace epoll_server;
+
+// Return the resident set size of the process in bytes.
+static size_t GetRss() {
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == nullptr) {
+    return 0;
+  }
+
+  unsigned long pages = 0;
+  unsigned long resident = 0;
+  if (fscanf(file, "%lu %lu", &pages, &resident) != 2) {
+    resident = 0;
+  }
+
+  fclose(file);
+  return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Serve one request on the connection through the socket pair. Return false if failed.
+static bool ServeOne(Connection* conn, int fds[2], const std::string& request) {
+  conn->set_fd(fds[0]);
+
+  bool ok = write(fds[1], request.data(), request.size()) ==
+            static_cast<ssize_t>(request.size()) && conn->HandleRead();
+
+  MessagePtr msg;
+  ok = ok && conn->ParseMessage(&msg) && msg;
+  if (ok) {
+    conn->AppendSendMessage(Message::Create(conn->handle(), msg->code, std::string("Ayou")));
+    msg.reset();
+    ok = conn->HandleWrite() && !conn->HasSendData();
+  }
+
+  char response[64];
+  ok = ok && read(fds[1], response, sizeof(response)) > 0;
+
+  // The socket pair is shared by all the connections, so it's not closed with the connection.
+  conn->set_fd(-1);
+  return ok;
+}
+
+// Return the resident bytes per idle connection, or -1 if failed.
+static double Measure(size_t count) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    return -1;
+  }
+
+  std::string data = "hello";
+  char header[Message::kHeaderLen];
+  Uint16ToBytes(kLittleEndian, static_cast<uint16_t>(data.size()), &header[0]);
+  Uint16ToBytes(kLittleEndian, 2020, &header[2]);
+  Uint32ToBytes(kLittleEndian, CalcCRC32(data), &header[4]);
+  std::string request = std::string(header, sizeof(header)) + data;
+
+  // Warm up the pools of the thread, which are shared by all the connections.
+  BufferPool::ThreadLocal()->Get()->Unref();
+  Message::Create();
+
+  size_t rss = GetRss();
+
+  ConnectionTable::GetInstance()->Init(count);
+  ConnectionPool pool;
+  if (!pool.Init(count)) {
+    return -1;
+  }
+
+  std::vector<Connection*> conns;
+  conns.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    Connection* conn = pool.Get();
+    if (!ServeOne(conn, fds, request)) {
+      return -1;
+    }
+    conns.push_back(conn);
+  }
+
+  // The vector of the connections is not counted.
+  size_t idle_rss = GetRss() - count * sizeof(Connection*);
+  return static_cast<double>(idle_rss - rss) / count;
+}
+
+int main(int argc, char** argv) {
+  std::vector<size_t> counts;
+  for (int i = 1; i < argc; ++i) {
+    counts.push_back(strtoul(argv[i], nullptr, 10));
+  }
+
+  if (counts.empty()) {
+    counts = {10000, 100000, 1000000};
+  }
+
+  printf("sizeof(Connection): %zu bytes.\n", sizeof(Connection));
+  for (size_t count : counts) {
+    // The result is passed by the pipe from the child process.
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) {
+      return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      double bytes = Measure(count);
+      ssize_t n = write(pipe_fds[1], &bytes, sizeof(bytes));
+      _exit(n == sizeof(bytes) ? 0 : 1);
+    }
+
+    double bytes = -1;
+    if (pid < 0 || read(pipe_fds[0], &bytes, sizeof(bytes)) != sizeof(bytes)) {
+      bytes = -1;
+    }
+
+    waitpid(pid, nullptr, 0);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+
+    if (bytes < 0) {
+      printf("%8zu connections: failed\n", count);
+    } else {
+      printf("%8zu connections: %8.1f bytes/connection\n", count, bytes);
+    }
+  }
+
+  return 0;
+}
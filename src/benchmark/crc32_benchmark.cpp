@@ -0,0 +1,106 @@
+// Measure the throughput of the CRC32 kernels across payload sizes. The results of all the
+// kernels are checked against the bytewise kernel first.
+//
+// Usage: ./crc32_benchmark [max_data_length] [bytes_per_run]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "epoll_server/crc32.h"
+
+using namespace epoll_server;
+
+static std::string MakeData(size_t size) {
+  std::string data(size, 0);
+  uint32_t seed = 2020;
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<char>(seed >> 16);
+  }
+
+  return data;
+}
+
+static bool Check(Crc32Kernel kernel, const std::string& data) {
+  // Every size and alignment up to 256 bytes, then some larger sizes.
+  for (size_t offset = 0; offset < 16; ++offset) {
+    for (size_t size = 0; offset + size <= data.size(); size += size < 256 ? 1 : 997) {
+      const char* p = data.data() + offset;
+      if (CalcCRC32(kernel, p, size) != CalcCRC32(kCrc32Bytewise, p, size)) {
+        printf("%s: wrong CRC32 of %zu bytes at offset %zu.\n", GetCrc32KernelName(kernel),
+               size, offset);
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Return GB/s.
+static double Run(Crc32Kernel kernel, const std::string& data, size_t size, size_t total) {
+  size_t count = total / size + 1;
+  unsigned int sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; ++i) {
+    sink += CalcCRC32(kernel, data.data(), size);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  if (sink == 1) {
+    printf(" ");
+  }
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return count * size / seconds / 1e9;
+}
+
+int main(int argc, char** argv) {
+  size_t max_data_length = argc > 1 ? strtoul(argv[1], nullptr, 10) : 65535;
+  size_t total = argc > 2 ? strtoul(argv[2], nullptr, 10) : 256 * 1024 * 1024;
+
+  std::string data = MakeData(max_data_length + 16);
+
+  std::vector<Crc32Kernel> kernels;
+  for (int i = 0; i < kCrc32KernelCount; ++i) {
+    Crc32Kernel kernel = static_cast<Crc32Kernel>(i);
+    if (!IsCrc32KernelSupported(kernel)) {
+      printf("%s: not supported.\n", GetCrc32KernelName(kernel));
+      continue;
+    }
+
+    if (!Check(kernel, data)) {
+      return 1;
+    }
+
+    kernels.push_back(kernel);
+  }
+
+  printf("Default kernel: %s. GB/s:\n", GetCrc32KernelName(GetCrc32Kernel()));
+  printf("%8s", "size");
+  for (Crc32Kernel kernel : kernels) {
+    printf(" %12s", GetCrc32KernelName(kernel));
+  }
+  printf("\n");
+
+  for (size_t size = 16; ; size *= 4) {
+    size = std::min(size, max_data_length);
+
+    printf("%8zu", size);
+    for (Crc32Kernel kernel : kernels) {
+      printf(" %12.2f", Run(kernel, data, size, total));
+    }
+    printf("\n");
+
+    if (size == max_data_length) {
+      break;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,235 @@
+// Count the heap allocations of the request and response messages passing through the
+// pipeline: I/O thread -> request queue -> worker thread -> response queue -> I/O thread.
+// 1. std::make_shared messages, std::list request queue and mutex + vector response queue.
+// 2. Pooled messages with intrusive reference count, ring buffer request queue and MPSC
+//    response queue.
+// The requests/s is printed for reference only. It's dominated by the thread handoff and varies
+// between runs more than the two pipelines differ.
+//
+// Usage: ./message_alloc_benchmark [requests] [batch_size]
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "epoll_server/connection.h"
+#include "epoll_server/connection_pool.h"
+#include "epoll_server/connection_table.h"
+#include "epoll_server/message.h"
+#include "epoll_server/mpsc_queue.h"
+#include "epoll_server/thread_safe_queue.h"
+
+using namespace epoll_server;
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+struct Result {
+  double seconds;
+  uint64_t allocations;
+};
+
+// The pipeline before pooling.
+class SharedPipeline {
+public:
+  using Ptr = std::shared_ptr<Message>;
+
+  explicit SharedPipeline(ConnectionHandle conn) : conn_(conn) {
+  }
+
+  Ptr CreateRequest() {
+    Ptr request = std::make_shared<Message>();
+    request->set_conn_handle(conn_);
+    return request;
+  }
+
+  void AddRequest(Ptr request) {
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    requests_.push_back(std::move(request));
+    request_cv_.notify_one();
+  }
+
+  // Return false if stopped.
+  bool HandleRequest() {
+    Ptr request;
+    {
+      std::unique_lock<std::mutex> lock(request_mutex_);
+      request_cv_.wait(lock, [this]() {
+        return !requests_.empty();
+      });
+
+      request = std::move(requests_.front());
+      requests_.pop_front();
+    }
+
+    if (!request) {
+      return false;
+    }
+
+    Ptr response = std::make_shared<Message>(conn_, request->code, std::string("Ayou"));
+    std::lock_guard<std::mutex> lock(response_mutex_);
+    responses_.push_back(std::move(response));
+    return true;
+  }
+
+  size_t DrainResponses() {
+    std::vector<Ptr> responses;
+    {
+      std::lock_guard<std::mutex> lock(response_mutex_);
+      responses.swap(responses_);
+    }
+
+    return responses.size();
+  }
+
+  void Stop() {
+    AddRequest(Ptr());
+  }
+
+private:
+  ConnectionHandle conn_;
+
+  std::mutex request_mutex_;
+  std::condition_variable request_cv_;
+  std::list<Ptr> requests_;
+
+  std::mutex response_mutex_;
+  std::vector<Ptr> responses_;
+};
+
+// The pipeline with pooled messages.
+class PooledPipeline {
+public:
+  using Ptr = MessagePtr;
+
+  explicit PooledPipeline(ConnectionHandle conn) : conn_(conn) {
+  }
+
+  Ptr CreateRequest() {
+    Ptr request = Message::Create();
+    request->set_conn_handle(conn_);
+    return request;
+  }
+
+  void AddRequest(Ptr request) {
+    requests_.Push(std::move(request));
+  }
+
+  bool HandleRequest() {
+    Ptr request = requests_.PopOrWait();
+    if (!request) {
+      return false;
+    }
+
+    responses_.Push(Message::Create(conn_, request->code, std::string("Ayou")));
+    return true;
+  }
+
+  size_t DrainResponses() {
+    size_t count = 0;
+    while (responses_.Pop()) {
+      ++count;
+    }
+
+    return count;
+  }
+
+  void Stop() {
+    AddRequest(Ptr());
+  }
+
+private:
+  ConnectionHandle conn_;
+  ThreadSafeQueue<Ptr> requests_;
+  MpscQueue<Message> responses_;
+};
+
+// Send the requests in batches and wait for all the responses of a batch, so the messages in
+// flight are bounded like a real server.
+template <class Pipeline>
+static void RunBatches(Pipeline* pipeline, size_t requests, size_t batch_size) {
+  for (size_t sent = 0; sent < requests; sent += batch_size) {
+    for (size_t i = 0; i < batch_size; ++i) {
+      pipeline->AddRequest(pipeline->CreateRequest());
+    }
+
+    size_t received = 0;
+    while (received < batch_size) {
+      received += pipeline->DrainResponses();
+    }
+  }
+}
+
+template <class Pipeline>
+static Result Run(ConnectionHandle conn, size_t requests, size_t batch_size) {
+  Pipeline pipeline(conn);
+  std::thread worker([&pipeline]() {
+    while (pipeline.HandleRequest()) {
+    }
+  });
+
+  // Warm up the pools and the queues.
+  RunBatches(&pipeline, batch_size * 4, batch_size);
+
+  uint64_t allocations = g_allocations.load();
+  auto start = std::chrono::steady_clock::now();
+
+  RunBatches(&pipeline, requests, batch_size);
+
+  auto end = std::chrono::steady_clock::now();
+  allocations = g_allocations.load() - allocations;
+
+  pipeline.Stop();
+  worker.join();
+
+  Result result;
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.allocations = allocations;
+  return result;
+}
+
+static void Print(const char* name, const Result& result, size_t requests) {
+  printf("%-14s %12.0f requests/s %10.4f allocations/request\n", name,
+         requests / result.seconds, static_cast<double>(result.allocations) / requests);
+}
+
+int main(int argc, char** argv) {
+  size_t requests = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t batch_size = argc > 2 ? strtoul(argv[2], nullptr, 10) : 256;
+  requests = (requests + batch_size - 1) / batch_size * batch_size;
+
+  ConnectionTable::GetInstance()->Init(1);
+  ConnectionPool connection_pool;
+  connection_pool.Init(1);
+  ConnectionHandle conn = connection_pool.Get()->handle();
+
+  printf("Requests: %zu, batch size: %zu.\n", requests, batch_size);
+  Print("shared_ptr", Run<SharedPipeline>(conn, requests, batch_size), requests);
+  Print("pooled", Run<PooledPipeline>(conn, requests, batch_size), requests);
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+// Compare the handoff of responses from worker threads to the I/O thread:
+// 1. Mutex + vector, and write the eventfd for every response.
+// 2. Lock-free MPSC queue, and only the first response after a drain writes the eventfd.
+//
+// Usage: ./response_queue_benchmark [producer_count] [responses_per_producer]
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "epoll_server/message.h"
+#include "epoll_server/mpsc_queue.h"
+
+using namespace epoll_server;
+
+struct Result {
+  double seconds;
+  uint64_t eventfd_writes;
+  uint64_t epoll_waits;
+};
+
+class MutexHandoff {
+public:
+  void Push(MessagePtr msg) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      responses_.push_back(std::move(msg));
+    }
+
+    WakeUp();
+  }
+
+  size_t Drain() {
+    std::vector<MessagePtr> responses;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      responses.swap(responses_);
+    }
+
+    return responses.size();
+  }
+
+  void WakeUp() {
+    uint64_t one = 1;
+    if (write(wakener_fd, &one, sizeof(one)) == sizeof(one)) {
+      ++eventfd_writes;
+    }
+  }
+
+  int wakener_fd = -1;
+  std::atomic<uint64_t> eventfd_writes{0};
+
+private:
+  std::mutex mutex_;
+  std::vector<MessagePtr> responses_;
+};
+
+class MpscHandoff {
+public:
+  void Push(MessagePtr msg) {
+    responses_.Push(std::move(msg));
+
+    if (wakeup_pending_.exchange(true)) {
+      return;
+    }
+
+    uint64_t one = 1;
+    if (write(wakener_fd, &one, sizeof(one)) == sizeof(one)) {
+      ++eventfd_writes;
+    }
+  }
+
+  size_t Drain() {
+    wakeup_pending_.store(false);
+
+    size_t count = 0;
+    while (responses_.Pop()) {
+      ++count;
+    }
+
+    return count;
+  }
+
+  int wakener_fd = -1;
+  std::atomic<uint64_t> eventfd_writes{0};
+
+private:
+  MpscQueue<Message> responses_;
+  std::atomic<bool> wakeup_pending_{false};
+};
+
+template <class Handoff>
+Result Run(size_t producer_count, size_t responses_per_producer) {
+  Handoff handoff;
+  handoff.wakener_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, handoff.wakener_fd, &ev);
+
+  // Create the messages before timing to only measure the handoff.
+  std::vector<std::vector<MessagePtr>> messages(producer_count);
+  for (auto& producer_messages : messages) {
+    for (size_t i = 0; i < responses_per_producer; ++i) {
+      producer_messages.push_back(Message::Create());
+    }
+  }
+
+  const size_t total = producer_count * responses_per_producer;
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for (size_t i = 0; i < producer_count; ++i) {
+    producers.emplace_back([&handoff, &messages, i]() {
+      for (MessagePtr& msg : messages[i]) {
+        handoff.Push(std::move(msg));
+      }
+    });
+  }
+
+  // The I/O thread.
+  uint64_t epoll_waits = 0;
+  size_t received = 0;
+  while (received < total) {
+    struct epoll_event events[1];
+    epoll_wait(epoll_fd, events, 1, -1);
+    ++epoll_waits;
+
+    uint64_t value = 0;
+    if (read(handoff.wakener_fd, &value, sizeof(value)) < 0) {
+      value = 0;
+    }
+
+    received += handoff.Drain();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+
+  close(epoll_fd);
+  close(handoff.wakener_fd);
+
+  Result result;
+  result.seconds = std::chrono::duration<double>(end - start).count();
+  result.eventfd_writes = handoff.eventfd_writes;
+  result.epoll_waits = epoll_waits;
+  return result;
+}
+
+static void Print(const char* name, const Result& result, size_t total) {
+  printf("%-14s %12.0f responses/s %10.6f eventfd writes/response %10.6f epoll_waits/response\n",
+         name, total / result.seconds, static_cast<double>(result.eventfd_writes) / total,
+         static_cast<double>(result.epoll_waits) / total);
+}
+
+int main(int argc, char** argv) {
+  size_t producer_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 8;
+  size_t responses_per_producer = argc > 2 ? strtoul(argv[2], nullptr, 10) : 200000;
+  size_t total = producer_count * responses_per_producer;
+
+  printf("Producers: %zu, responses: %zu.\n", producer_count, total);
+  Print("mutex+vector", Run<MutexHandoff>(producer_count, responses_per_producer), total);
+  Print("mpsc", Run<MpscHandoff>(producer_count, responses_per_producer), total);
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+// Compare the dispatch of requests to routers from many worker threads:
+// 1. std::unordered_map<uint16_t, RouterPtr> lookup and copy the shared_ptr.
+// 2. Direct indexed 65536-entry table of raw router pointers.
+// Only the dispatch is measured. The routers are not called.
+//
+// Usage: ./router_dispatch_benchmark [thread_count] [dispatches_per_thread]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "epoll_server/router_base.h"
+
+using namespace epoll_server;
+
+class Router : public RouterBase {
+  std::string HandleRequest(MessagePtr /*msg*/) override {
+    return std::string();
+  }
+};
+
+// The message codes of requests, 16 hot codes.
+static std::vector<uint16_t> MakeCodes(size_t count) {
+  std::vector<uint16_t> codes(count);
+  uint32_t seed = 2020;
+  for (size_t i = 0; i < count; ++i) {
+    seed = seed * 1103515245 + 12345;
+    codes[i] = static_cast<uint16_t>(2000 + (seed >> 16) % 16);
+  }
+
+  return codes;
+}
+
+template <class Dispatch>
+double Run(size_t thread_count, const std::vector<uint16_t>& codes, Dispatch dispatch) {
+  std::atomic<uintptr_t> sink(0);
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back([&codes, &dispatch, &sink]() {
+      uintptr_t sum = 0;
+      for (uint16_t code : codes) {
+        sum += dispatch(code);
+      }
+
+      sink += sum;
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+static void Print(const char* name, double seconds, size_t thread_count, size_t dispatches) {
+  printf("%-14s %12.0f dispatches/s %8.2f ns/dispatch per thread\n", name,
+         thread_count * dispatches / seconds, seconds * 1e9 / dispatches);
+}
+
+int main(int argc, char** argv) {
+  size_t thread_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 8;
+  size_t dispatches = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000000;
+
+  std::vector<uint16_t> codes = MakeCodes(dispatches);
+
+  std::unordered_map<uint16_t, RouterPtr> router_map;
+  std::vector<RouterBase*> router_table(static_cast<size_t>(UINT16_MAX) + 1, nullptr);
+  for (uint16_t code = 2000; code < 2016; ++code) {
+    RouterPtr router(new Router);
+    router_map[code] = router;
+    router_table[code] = router.get();
+  }
+
+  printf("Threads: %zu, dispatches per thread: %zu.\n", thread_count, dispatches);
+
+  double seconds = Run(thread_count, codes, [&router_map](uint16_t code) {
+    RouterPtr router;
+    auto it = router_map.find(code);
+    if (it != router_map.end()) {
+      router = it->second;
+    }
+
+    return reinterpret_cast<uintptr_t>(router.get());
+  });
+  Print("map+shared_ptr", seconds, thread_count, dispatches);
+
+  seconds = Run(thread_count, codes, [&router_table](uint16_t code) {
+    return reinterpret_cast<uintptr_t>(router_table[code]);
+  });
+  Print("flat table", seconds, thread_count, dispatches);
+
+  return 0;
+}
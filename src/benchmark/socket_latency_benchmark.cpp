@@ -0,0 +1,360 @@
+// Measure the effect of the socket options on latency over loopback. The options are applied by
+// the same functions as the server.
+//
+// Round trip: The client sends every request by two writes (header and body) and the server
+// responds by two writes too, like a streaming response. Nagle delays the second write until
+// the first one is acked, and the peer delays the ack.
+// Connect: A new connection for every request, with TCP_DEFER_ACCEPT or TCP_FASTOPEN.
+// Bulk: A 1 MiB response with different socket buffer sizes.
+//
+// Usage: ./socket_latency_benchmark [round_trips]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "epoll_server/config.h"
+#include "epoll_server/socket_options.h"
+#include "epoll_server/utils.h"
+
+using namespace epoll_server;
+
+static const size_t kHeaderLen = 8;
+
+static bool WriteAll(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+
+  return true;
+}
+
+// Re-arm the quick ack after every read like the server.
+static bool ReadAll(int fd, char* data, size_t len, bool quick_ack) {
+  while (len > 0) {
+    ssize_t n = recv(fd, data, len, 0);
+    if (n <= 0) {
+      return false;
+    }
+
+    if (quick_ack) {
+      SetQuickAck(fd);
+    }
+
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+
+  return true;
+}
+
+// The request and the response: a 8-byte header with the body length, then the body.
+static bool WriteFrame(int fd, const std::string& body) {
+  char header[kHeaderLen] = {0};
+  Uint32ToBytes(kLittleEndian, static_cast<uint32_t>(body.size()), header);
+  return WriteAll(fd, header, kHeaderLen) && WriteAll(fd, body.data(), body.size());
+}
+
+static bool ReadFrame(int fd, std::string* body, bool quick_ack = false) {
+  char header[kHeaderLen];
+  if (!ReadAll(fd, header, kHeaderLen, quick_ack)) {
+    return false;
+  }
+
+  body->resize(BytesToUint32(kLittleEndian, header));
+  return body->empty() || ReadAll(fd, &(*body)[0], body->size(), quick_ack);
+}
+
+// The server of one variant. The request body is the response length.
+class Server {
+public:
+  Server() : fd_(-1), port_(0) {
+  }
+
+  ~Server() {
+    if (fd_ != -1) {
+      shutdown(fd_, SHUT_RDWR);
+      close(fd_);
+    }
+
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  bool Start() {
+    fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    SetListenSocketOptions(fd_);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), len) != 0 ||
+        listen(fd_, static_cast<int>(CONFIG.listen_backlog)) != 0 ||
+        getsockname(fd_, reinterpret_cast<struct sockaddr*>(&addr), &len) != 0) {
+      return false;
+    }
+
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() {
+      for (;;) {
+        int conn = accept(fd_, nullptr, nullptr);
+        if (conn == -1) {
+          return;
+        }
+
+        SetAcceptedSocketOptions(conn);
+        Serve(conn);
+        close(conn);
+      }
+    });
+
+    return true;
+  }
+
+  unsigned short port() const {
+    return port_;
+  }
+
+private:
+  static void Serve(int fd) {
+    std::string request;
+    while (ReadFrame(fd, &request, CONFIG.tcp_quick_ack)) {
+      if (!WriteFrame(fd, std::string(std::strtoul(request.c_str(), nullptr, 10), 'a'))) {
+        return;
+      }
+    }
+  }
+
+private:
+  int fd_;
+  unsigned short port_;
+  std::thread thread_;
+};
+
+static int Connect(unsigned short port, const std::string* fast_open_request = nullptr) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+
+  // Send the first request in SYN if the cookie is cached.
+  if (fast_open_request != nullptr) {
+    char header[kHeaderLen] = {0};
+    Uint32ToBytes(kLittleEndian, static_cast<uint32_t>(fast_open_request->size()), header);
+    std::string frame = std::string(header, kHeaderLen) + *fast_open_request;
+    ssize_t n = sendto(fd, frame.data(), frame.size(), MSG_FASTOPEN | MSG_NOSIGNAL,
+                       reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    if (n < 0 || !WriteAll(fd, frame.data() + n, frame.size() - n)) {
+      close(fd);
+      return -1;
+    }
+
+    return fd;
+  }
+
+  if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+struct Stats {
+  double p50_us;
+  double p99_us;
+  double avg_us;
+};
+
+static Stats Summarize(std::vector<double>* samples) {
+  std::sort(samples->begin(), samples->end());
+  double sum = 0;
+  for (double sample : *samples) {
+    sum += sample;
+  }
+
+  Stats stats;
+  stats.p50_us = (*samples)[samples->size() / 2];
+  stats.p99_us = (*samples)[samples->size() * 99 / 100];
+  stats.avg_us = sum / samples->size();
+  return stats;
+}
+
+static double Now() {
+  using namespace std::chrono;
+  return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Return false if failed.
+static bool RoundTrip(unsigned short port, size_t count, const std::string& request,
+                      std::vector<double>* samples) {
+  int fd = Connect(port);
+  if (fd == -1) {
+    return false;
+  }
+
+  std::string response;
+  for (size_t i = 0; i < count; ++i) {
+    double start = Now();
+    if (!WriteFrame(fd, request) || !ReadFrame(fd, &response)) {
+      close(fd);
+      return false;
+    }
+    samples->push_back(Now() - start);
+  }
+
+  close(fd);
+  return true;
+}
+
+static bool ConnectRoundTrip(unsigned short port, size_t count, bool fast_open,
+                             std::vector<double>* samples) {
+  const std::string request = "16";
+  std::string response;
+  for (size_t i = 0; i < count; ++i) {
+    double start = Now();
+    int fd = fast_open ? Connect(port, &request) : Connect(port);
+    if (fd == -1) {
+      return false;
+    }
+
+    bool ok = (fast_open || WriteFrame(fd, request)) && ReadFrame(fd, &response);
+    close(fd);
+    if (!ok) {
+      return false;
+    }
+    samples->push_back(Now() - start);
+  }
+
+  return true;
+}
+
+// Reset the options to the system defaults.
+static void ResetOptions() {
+  CONFIG.listen_backlog = 511;
+  CONFIG.tcp_defer_accept_sec = 0;
+  CONFIG.tcp_fast_open_queue = 0;
+  CONFIG.send_buffer_size = 0;
+  CONFIG.receive_buffer_size = 0;
+  CONFIG.tcp_no_delay = false;
+  CONFIG.tcp_quick_ack = false;
+  CONFIG.tcp_not_sent_lowat = 0;
+  CONFIG.busy_poll_us = 0;
+  CONFIG.keep_alive = false;
+}
+
+static void Run(const char* name, const std::function<void()>& set_options,
+                const std::function<bool(unsigned short, std::vector<double>*)>& run) {
+  ResetOptions();
+  set_options();
+
+  Server server;
+  std::vector<double> samples;
+  if (!server.Start() || !run(server.port(), &samples) || samples.empty()) {
+    printf("%-34s failed\n", name);
+    return;
+  }
+
+  Stats stats = Summarize(&samples);
+  printf("%-34s %10.1f %10.1f %10.1f\n", name, stats.p50_us, stats.p99_us, stats.avg_us);
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+
+  printf("%-34s %10s %10s %10s\n", "variant (us)", "p50", "p99", "avg");
+
+  auto round_trip = [count](unsigned short port, std::vector<double>* samples) {
+    return RoundTrip(port, count, "64", samples);
+  };
+
+  Run("rtt default", []() {}, round_trip);
+  Run("rtt nodelay", []() { CONFIG.tcp_no_delay = true; }, round_trip);
+  Run("rtt quickack", []() { CONFIG.tcp_quick_ack = true; }, round_trip);
+  Run("rtt nodelay+quickack", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+  }, round_trip);
+  Run("rtt nodelay+quickack+notsent_lowat", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+    CONFIG.tcp_not_sent_lowat = 16384;
+  }, round_trip);
+  Run("rtt nodelay+quickack+busy_poll", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+    CONFIG.busy_poll_us = 50;
+  }, round_trip);
+  Run("rtt nodelay+quickack+keepalive", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+    CONFIG.keep_alive = true;
+  }, round_trip);
+
+  auto connect_round_trip = [count](unsigned short port, std::vector<double>* samples) {
+    return ConnectRoundTrip(port, count, false, samples);
+  };
+
+  Run("connect nodelay", []() { CONFIG.tcp_no_delay = true; }, connect_round_trip);
+  Run("connect defer_accept", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_defer_accept_sec = 1;
+  }, connect_round_trip);
+  Run("connect fastopen", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_fast_open_queue = 64;
+  }, [count](unsigned short port, std::vector<double>* samples) {
+    // The first connection gets the cookie.
+    std::vector<double> warm_up;
+    return ConnectRoundTrip(port, 1, true, &warm_up) &&
+           ConnectRoundTrip(port, count, true, samples);
+  });
+  Run("connect backlog 16", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.listen_backlog = 16;
+  }, connect_round_trip);
+
+  auto bulk = [count](unsigned short port, std::vector<double>* samples) {
+    return RoundTrip(port, std::max<size_t>(count / 10, 1), "1048576", samples);
+  };
+
+  Run("bulk 1MiB default buffers", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+  }, bulk);
+  Run("bulk 1MiB sndbuf 16KiB", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+    CONFIG.send_buffer_size = 16384;
+  }, bulk);
+  Run("bulk 1MiB sndbuf 4MiB", []() {
+    CONFIG.tcp_no_delay = true;
+    CONFIG.tcp_quick_ack = true;
+    CONFIG.send_buffer_size = 4 * 1024 * 1024;
+  }, bulk);
+
+  return 0;
+}
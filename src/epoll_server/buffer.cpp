@@ -0,0 +1,75 @@
+#include "epoll_server/buffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace epoll_server {
+
+Buffer::Buffer()
+    : block_(nullptr)
+    , read_index_(0)
+    , write_index_(0) {
+}
+
+Buffer::~Buffer() {
+  RetrieveAll();
+}
+
+void Buffer::HasWritten(size_t len) {
+  assert(len <= WritableBytes());
+  write_index_ += len;
+}
+
+void Buffer::Retrieve(size_t len) {
+  assert(len <= ReadableBytes());
+  read_index_ += len;
+
+  // Release the block if all the data is consumed. The slices may still refer to it.
+  if (read_index_ == write_index_) {
+    RetrieveAll();
+  }
+}
+
+void Buffer::RetrieveAll() {
+  if (block_ != nullptr) {
+    block_->Unref();
+    block_ = nullptr;
+  }
+
+  read_index_ = 0;
+  write_index_ = 0;
+}
+
+void Buffer::EnsureWritable(size_t len, size_t block_size) {
+  if (WritableBytes() >= len) {
+    return;
+  }
+
+  size_t readable = ReadableBytes();
+  if (block_ != nullptr && !block_->Shared() && read_index_ + WritableBytes() >= len) {
+    memmove(block_->data(), block_->data() + read_index_, readable);
+  } else {
+    size_t capacity = std::max(readable + len, block_size);
+    BufferBlock* block = BufferPool::ThreadLocal()->Get(capacity);
+    if (block_ != nullptr) {
+      memcpy(block->data(), block_->data() + read_index_, readable);
+      block_->Unref();
+    }
+    block_ = block;
+  }
+
+  read_index_ = 0;
+  write_index_ = readable;
+}
+
+Slice Buffer::MakeSlice(size_t offset, size_t len) const {
+  assert(offset + len <= ReadableBytes());
+  if (len == 0) {
+    return Slice();
+  }
+
+  return Slice(block_, block_->data() + read_index_ + offset, len);
+}
+
+}  // namespace epoll_server
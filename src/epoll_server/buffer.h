@@ -0,0 +1,72 @@
+#ifndef EPOLL_SERVER_BUFFER_H_
+#define EPOLL_SERVER_BUFFER_H_
+
+#include <cstddef>
+
+#include "epoll_server/buffer_pool.h"
+#include "epoll_server/noncopyable.h"
+#include "epoll_server/slice.h"
+
+namespace epoll_server {
+
+// A contiguous byte buffer. The data is appended at the write index and consumed from the
+// read index.
+//
+// +-------------------+------------------+------------------+
+// | consumed bytes    |  readable bytes  |  writable bytes  |
+// +-------------------+------------------+------------------+
+// 0              read_index        write_index          size
+//
+// The memory is a block from the buffer pool of the current thread. The readable bytes can be
+// referred by slices without copy. The block is released when all the bytes are consumed, and
+// it's returned to the pool after the slices referring to it are destroyed.
+
+class Buffer : private Noncopyable {
+public:
+  Buffer();
+
+  ~Buffer();
+
+  size_t ReadableBytes() const {
+    return write_index_ - read_index_;
+  }
+
+  size_t WritableBytes() const {
+    return block_ != nullptr ? block_->capacity() - write_index_ : 0;
+  }
+
+  size_t Capacity() const {
+    return block_ != nullptr ? block_->capacity() : 0;
+  }
+
+  const char* Peek() const {
+    return block_->data() + read_index_;
+  }
+
+  char* BeginWrite() {
+    return block_->data() + write_index_;
+  }
+
+  void HasWritten(size_t len);
+
+  void Retrieve(size_t len);
+
+  void RetrieveAll();
+
+  // Make sure at least len bytes are writable. The readable bytes are moved to the front if
+  // the consumed space is enough and no slice refers to it. Otherwise they are copied to a new
+  // block of at least block_size bytes.
+  void EnsureWritable(size_t len, size_t block_size = BufferPool::kBlockSize);
+
+  // Return the slice of len readable bytes after offset.
+  Slice MakeSlice(size_t offset, size_t len) const;
+
+private:
+  BufferBlock* block_;
+  size_t read_index_;
+  size_t write_index_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_BUFFER_H_
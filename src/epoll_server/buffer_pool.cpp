@@ -0,0 +1,107 @@
+#include "epoll_server/buffer_pool.h"
+
+namespace epoll_server {
+
+const size_t BufferPool::kMinBlockSize;
+const size_t BufferPool::kBlockSize;
+const size_t BufferPool::kSizeClassCount;
+const size_t BufferPool::kMaxFreeBytes;
+
+BufferBlock::BufferBlock(BufferPool* pool, size_t capacity)
+    : refs_(1)
+    , pool_(pool)
+    , capacity_(capacity)
+    , data_(new char[capacity])
+    , next_(nullptr) {
+}
+
+BufferBlock::~BufferBlock() {
+  delete[] data_;
+}
+
+void BufferBlock::Unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  pool_->Put(this);
+}
+
+BufferPool* BufferPool::ThreadLocal() {
+  static thread_local BufferPool* pool = new BufferPool;
+  return pool;
+}
+
+BufferPool::BufferPool() : owner_(std::this_thread::get_id()) {
+  for (size_t i = 0; i < kSizeClassCount; ++i) {
+    free_blocks_[i] = nullptr;
+    free_count_[i] = 0;
+    remote_free_blocks_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+size_t BufferPool::GetSizeClass(size_t capacity) {
+  size_t size_class = 0;
+  while (size_class < kSizeClassCount && GetClassSize(size_class) < capacity) {
+    ++size_class;
+  }
+
+  return size_class;
+}
+
+BufferBlock* BufferPool::Get(size_t capacity) {
+  size_t size_class = GetSizeClass(capacity);
+  if (size_class == kSizeClassCount) {
+    return new BufferBlock(this, capacity);
+  }
+
+  BufferBlock*& free_blocks = free_blocks_[size_class];
+  if (free_blocks == nullptr) {
+    free_blocks = remote_free_blocks_[size_class].exchange(nullptr, std::memory_order_acquire);
+    free_count_[size_class] = 0;
+    for (BufferBlock* block = free_blocks; block != nullptr; block = block->next_) {
+      ++free_count_[size_class];
+    }
+  }
+
+  if (free_blocks == nullptr) {
+    return new BufferBlock(this, GetClassSize(size_class));
+  }
+
+  BufferBlock* block = free_blocks;
+  free_blocks = block->next_;
+  --free_count_[size_class];
+
+  block->next_ = nullptr;
+  block->refs_.store(1, std::memory_order_relaxed);
+  return block;
+}
+
+void BufferPool::Put(BufferBlock* block) {
+  size_t size_class = GetSizeClass(block->capacity());
+  if (size_class == kSizeClassCount || block->capacity() != GetClassSize(size_class)) {
+    delete block;
+    return;
+  }
+
+  if (std::this_thread::get_id() != owner_) {
+    std::atomic<BufferBlock*>& remote_free_blocks = remote_free_blocks_[size_class];
+    BufferBlock* head = remote_free_blocks.load(std::memory_order_relaxed);
+    do {
+      block->next_ = head;
+    } while (!remote_free_blocks.compare_exchange_weak(head, block, std::memory_order_release,
+                                                       std::memory_order_relaxed));
+    return;
+  }
+
+  if (free_count_[size_class] * block->capacity() >= kMaxFreeBytes) {
+    delete block;
+    return;
+  }
+
+  block->next_ = free_blocks_[size_class];
+  free_blocks_[size_class] = block;
+  ++free_count_[size_class];
+}
+
+}  // namespace epoll_server
@@ -0,0 +1,107 @@
+#ifndef EPOLL_SERVER_BUFFER_POOL_H_
+#define EPOLL_SERVER_BUFFER_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#include "epoll_server/noncopyable.h"
+
+namespace epoll_server {
+
+class BufferPool;
+
+// A memory block shared by the receive buffer and the request payloads referring to it. The
+// block is returned to its pool when the last reference is released.
+
+class BufferBlock : private Noncopyable {
+public:
+  char* data() {
+    return data_;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  // Thread safe.
+  void Ref() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Thread safe.
+  void Unref();
+
+  // Some payloads still refer to the block.
+  bool Shared() const {
+    return refs_.load(std::memory_order_acquire) > 1;
+  }
+
+private:
+  friend class BufferPool;
+
+  BufferBlock(BufferPool* pool, size_t capacity);
+  ~BufferBlock();
+
+private:
+  std::atomic<int> refs_;
+  BufferPool* pool_;
+
+  size_t capacity_;
+  char* data_;
+
+  // The next free block in the pool.
+  BufferBlock* next_;
+};
+
+// The per thread pool of buffer blocks. The blocks got from the pool of a thread are returned
+// to the same pool, even if they are released in other threads.
+// The blocks are in size classes of 4 KiB, 16 KiB and 64 KiB, so a small frame doesn't hold a
+// large block.
+
+class BufferPool : private Noncopyable {
+public:
+  static const size_t kMinBlockSize = 4096;
+  static const size_t kBlockSize = 65536;
+
+  // Every class is 4 times of the previous one.
+  static const size_t kSizeClassCount = 3;
+
+  // The free blocks of a class more than it are freed.
+  static const size_t kMaxFreeBytes = 4 * 1024 * 1024;
+
+  // The pool of the current thread. It's never destroyed, because its blocks may be released
+  // in other threads after the thread exits.
+  static BufferPool* ThreadLocal();
+
+  // Return a block of the smallest size class not less than capacity, with one reference.
+  // The blocks larger than kBlockSize are not pooled.
+  BufferBlock* Get(size_t capacity = kBlockSize);
+
+  // Thread safe. Called by the block when the last reference is released.
+  void Put(BufferBlock* block);
+
+private:
+  BufferPool();
+
+  // Return kSizeClassCount if the capacity is larger than kBlockSize.
+  static size_t GetSizeClass(size_t capacity);
+
+  static size_t GetClassSize(size_t size_class) {
+    return kMinBlockSize << (2 * size_class);
+  }
+
+private:
+  std::thread::id owner_;
+
+  // Only used in the owner thread.
+  BufferBlock* free_blocks_[kSizeClassCount];
+  size_t free_count_[kSizeClassCount];
+
+  // The blocks released in other threads. The owner thread takes them all at once.
+  std::atomic<BufferBlock*> remote_free_blocks_[kSizeClassCount];
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_BUFFER_POOL_H_
@@ -0,0 +1,39 @@
+#include "epoll_server/codel.h"
+
+namespace epoll_server {
+
+Codel::Codel(int64_t target_us, int64_t interval_us)
+    : target_us_(target_us)
+    , interval_us_(interval_us)
+    , interval_end_us_(0)
+    , min_delay_us_(0)
+    , overloaded_(false) {
+}
+
+bool Codel::Overloaded(int64_t delay_us, int64_t now_us) {
+  if (target_us_ <= 0) {
+    return false;
+  }
+
+  int64_t interval_end_us = interval_end_us_.load(std::memory_order_acquire);
+  if (now_us >= interval_end_us &&
+      interval_end_us_.compare_exchange_strong(interval_end_us, now_us + interval_us_,
+                                               std::memory_order_acq_rel)) {
+    // The first request of a new interval. Judge the last interval by its minimum delay.
+    // A delay lowered by other workers during the rollover may be counted in either interval,
+    // which doesn't matter to the judgement.
+    int64_t min_delay_us = min_delay_us_.exchange(delay_us, std::memory_order_acq_rel);
+    bool overloaded = interval_end_us != 0 && min_delay_us > target_us_;
+    overloaded_.store(overloaded, std::memory_order_release);
+    return overloaded && delay_us > 2 * target_us_;
+  }
+
+  int64_t min_delay_us = min_delay_us_.load(std::memory_order_relaxed);
+  while (delay_us < min_delay_us &&
+         !min_delay_us_.compare_exchange_weak(min_delay_us, delay_us, std::memory_order_relaxed)) {
+  }
+
+  return overloaded_.load(std::memory_order_acquire) && delay_us > 2 * target_us_;
+}
+
+}  // namespace epoll_server
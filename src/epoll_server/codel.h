@@ -0,0 +1,39 @@
+#ifndef EPOLL_SERVER_CODEL_H_
+#define EPOLL_SERVER_CODEL_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "epoll_server/noncopyable.h"
+
+namespace epoll_server {
+
+// Overload detection in the style of CoDel (Controlled Delay). The queue is considered
+// overloaded if even the shortest queueing delay in the last interval is longer than the target,
+// which means a standing queue is built and it's not a short burst.
+// When overloaded, the requests queued longer than twice the target are shed. Their callers
+// probably have timed out, and shedding them drains the standing queue quickly.
+// It's lock free. The worker which rolls the interval over is elected by a CAS on the end of the
+// interval, and the minimum delay is lowered by CAS, so usually a request only loads the state.
+
+class Codel : private Noncopyable {
+public:
+  Codel(int64_t target_us, int64_t interval_us);
+
+  // Thread safe. Return true if the request with the queueing delay should be shed.
+  bool Overloaded(int64_t delay_us, int64_t now_us);
+
+private:
+  int64_t target_us_;
+  int64_t interval_us_;
+
+  // The end of the current interval and the minimum delay in it.
+  std::atomic<int64_t> interval_end_us_;
+  std::atomic<int64_t> min_delay_us_;
+
+  std::atomic<bool> overloaded_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_CODEL_H_
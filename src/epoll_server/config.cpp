@@ -2,24 +2,58 @@
 
 #include "epoll_server/json_helper.h"
 #include "epoll_server/logging.h"
+#include "epoll_server/message.h"
 
 namespace epoll_server {
 
 Config::Config()
-    : log_file_level("debug")
+    : log_filename("log/Server.log")
+    , log_file_level("debug")
     , log_console_level("fatal")
-    , log_filename("log/Server.log")
-    , log_rotate_size(5242880)
     , log_rotate_count(10)
-    , deamon_mode(false)
+    , log_rotate_size(5242880)
     , master_worker_mode(false)
     , process_worker_count(2)
+    , deamon_mode(false)
+    , master_title("ServerMaster")
+    , worker_title("ServerWorker")
     , port(9527)
     , connection_pool_size(20000)
     , thread_pool_size(4)
     , max_data_length(3000)
-    , master_title("ServerMaster")
-    , worker_title("ServerWorker") {
+    , max_chunk_length(32768)
+    , compression_threshold(1024)
+    , io_thread_count(1)
+    , edge_triggered(false)
+    , read_budget(16)
+    , accept_batch_size(64)
+    , io_backend("epoll")
+    , spin_poll_us(0)
+    , ordered_responses(false)
+    , reorder_window_size(64)
+    , idle_timeout_ms(0)
+    , partial_frame_timeout_ms(10000)
+    , send_high_watermark(4 * 1024 * 1024)
+    , send_low_watermark(1024 * 1024)
+    , inflight_high_watermark(1024)
+    , inflight_low_watermark(256)
+    , request_queue_capacity(100000)
+    , request_queue_target_ms(0)
+    , request_queue_interval_ms(100)
+    , overload_action("reject")
+    , listen_backlog(511)
+    , tcp_defer_accept_sec(0)
+    , tcp_fast_open_queue(0)
+    , send_buffer_size(0)
+    , receive_buffer_size(0)
+    , tcp_no_delay(true)
+    , tcp_quick_ack(false)
+    , tcp_not_sent_lowat(0)
+    , busy_poll_us(0)
+    , keep_alive(false)
+    , keep_alive_idle_sec(0)
+    , keep_alive_interval_sec(0)
+    , keep_alive_count(0) {
 }
 
 void Config::Load(const std::string& file_path) {
@@ -49,6 +83,73 @@ void Config::Load(const std::string& file_path) {
   connection_pool_size = socket_config["connectionPoolSize"].asUInt();
   thread_pool_size = socket_config["threadPoolSize"].asUInt();
   max_data_length = socket_config["maxDataLength"].asUInt();
+  if (max_data_length > Message::kMaxV1DataLength) {
+    max_data_length = Message::kMaxV1DataLength;
+  }
+  max_chunk_length = socket_config.get("maxChunkLength", max_chunk_length).asUInt();
+  if (max_chunk_length == 0) {
+    max_chunk_length = 1;
+  }
+
+  compression_threshold = socket_config.get("compressionThreshold", compression_threshold).asUInt();
+  io_thread_count = socket_config.get("ioThreadCount", io_thread_count).asUInt();
+  edge_triggered = socket_config.get("edgeTriggered", edge_triggered).asBool();
+  read_budget = socket_config.get("readBudget", read_budget).asUInt();
+  if (read_budget == 0) {
+    read_budget = 1;
+  }
+
+  accept_batch_size = socket_config.get("acceptBatchSize", accept_batch_size).asUInt();
+  if (accept_batch_size == 0) {
+    accept_batch_size = 1;
+  }
+
+  io_backend = socket_config.get("ioBackend", io_backend).asString();
+  spin_poll_us = socket_config.get("spinPollUs", spin_poll_us).asUInt();
+
+  ordered_responses = socket_config.get("orderedResponses", ordered_responses).asBool();
+  reorder_window_size = socket_config.get("reorderWindowSize", reorder_window_size).asUInt();
+  if (reorder_window_size == 0) {
+    reorder_window_size = 1;
+  }
+
+  idle_timeout_ms = socket_config.get("idleTimeoutMs", idle_timeout_ms).asUInt();
+  partial_frame_timeout_ms = socket_config.get("partialFrameTimeoutMs", partial_frame_timeout_ms).asUInt();
+
+  send_high_watermark = socket_config.get("sendHighWatermark", send_high_watermark).asUInt();
+  send_low_watermark = socket_config.get("sendLowWatermark", send_low_watermark).asUInt();
+  if (send_low_watermark > send_high_watermark) {
+    send_low_watermark = send_high_watermark;
+  }
+
+  inflight_high_watermark = socket_config.get("inflightHighWatermark", inflight_high_watermark).asUInt();
+  inflight_low_watermark = socket_config.get("inflightLowWatermark", inflight_low_watermark).asUInt();
+  if (inflight_low_watermark > inflight_high_watermark) {
+    inflight_low_watermark = inflight_high_watermark;
+  }
+
+  request_queue_capacity = socket_config.get("requestQueueCapacity", request_queue_capacity).asUInt();
+  request_queue_target_ms = socket_config.get("requestQueueTargetMs", request_queue_target_ms).asUInt();
+  request_queue_interval_ms = socket_config.get("requestQueueIntervalMs", request_queue_interval_ms).asUInt();
+  if (request_queue_interval_ms == 0) {
+    request_queue_interval_ms = 1;
+  }
+
+  overload_action = socket_config.get("overloadAction", overload_action).asString();
+
+  listen_backlog = socket_config.get("listenBacklog", listen_backlog).asUInt();
+  tcp_defer_accept_sec = socket_config.get("tcpDeferAcceptSec", tcp_defer_accept_sec).asUInt();
+  tcp_fast_open_queue = socket_config.get("tcpFastOpenQueue", tcp_fast_open_queue).asUInt();
+  send_buffer_size = socket_config.get("sendBufferSize", send_buffer_size).asUInt();
+  receive_buffer_size = socket_config.get("receiveBufferSize", receive_buffer_size).asUInt();
+  tcp_no_delay = socket_config.get("tcpNoDelay", tcp_no_delay).asBool();
+  tcp_quick_ack = socket_config.get("tcpQuickAck", tcp_quick_ack).asBool();
+  tcp_not_sent_lowat = socket_config.get("tcpNotSentLowat", tcp_not_sent_lowat).asUInt();
+  busy_poll_us = socket_config.get("busyPollUs", busy_poll_us).asUInt();
+  keep_alive = socket_config.get("keepAlive", keep_alive).asBool();
+  keep_alive_idle_sec = socket_config.get("keepAliveIdleSec", keep_alive_idle_sec).asUInt();
+  keep_alive_interval_sec = socket_config.get("keepAliveIntervalSec", keep_alive_interval_sec).asUInt();
+  keep_alive_count = socket_config.get("keepAliveCount", keep_alive_count).asUInt();
 }
 
 }  // namespace epoll_server
@@ -34,9 +34,88 @@ public:
 
   // Socket config.
   uint16_t port;
+  // The total of the connection pools, split evenly across the I/O threads.
   uint32_t connection_pool_size;
   uint32_t thread_pool_size;
+  // The maximum data length of protocol v1. It's at most Message::kMaxV1DataLength.
   uint32_t max_data_length;
+
+  // The maximum chunk length of protocol v2. The longer responses are sended as several chunks.
+  uint32_t max_chunk_length;
+
+  // The v2 response chunks of at least compression_threshold bytes are compressed if the client
+  // accepts compression. 0 disables.
+  uint32_t compression_threshold;
+
+  // The count of I/O threads. Every I/O thread runs an event loop with its own acceptor.
+  uint32_t io_thread_count;
+
+  // Register the sockets with EPOLLET. Read budget is the maximum count of messages read from
+  // a connection at a time.
+  bool edge_triggered;
+  uint32_t read_budget;
+
+  // The maximum count of connections accepted at a time.
+  uint32_t accept_batch_size;
+
+  // The I/O multiplexing backend: "epoll" or "io_uring".
+  std::string io_backend;
+
+  // After handling some events, the event loop polls without blocking for spin_poll_us
+  // microseconds before it blocks again. The responses are not woken up by the eventfd while
+  // spinning. 0 disables.
+  uint32_t spin_poll_us;
+
+  // Send the responses of a connection in the order of its requests. The reading of the
+  // connection is paused if reorder_window_size requests are waiting for responses.
+  bool ordered_responses;
+  uint32_t reorder_window_size;
+
+  // Close the connection if nothing is received or sended in idle_timeout_ms, or a message is
+  // not completed in partial_frame_timeout_ms after its first bytes are received. 0 disables.
+  // While some timeouts are scheduled, the blocking polling wakes up at every 100 ms tick of the
+  // timeout wheel.
+  uint32_t idle_timeout_ms;
+  uint32_t partial_frame_timeout_ms;
+
+  // Stop reading the connection if its outbound bytes or in flight requests reach the high
+  // watermark, and resume reading after both drop to the low watermark. 0 disables.
+  uint32_t send_high_watermark;
+  uint32_t send_low_watermark;
+  uint32_t inflight_high_watermark;
+  uint32_t inflight_low_watermark;
+
+  // The maximum count of requests queued to the thread pool. 0 means unbounded.
+  uint32_t request_queue_capacity;
+
+  // Shed the requests queued too long if the queueing delay keeps longer than the target for
+  // an interval. 0 target disables.
+  uint32_t request_queue_target_ms;
+  uint32_t request_queue_interval_ms;
+
+  // "reject": Respond the overloaded requests with Message::kCodeOverloaded.
+  // "drop": Drop the overloaded requests without response.
+  std::string overload_action;
+
+  // The options of the listening sockets. The accepted sockets inherit the buffer sizes.
+  // 0 keeps the system default.
+  uint32_t listen_backlog;
+  uint32_t tcp_defer_accept_sec;
+  uint32_t tcp_fast_open_queue;
+  uint32_t send_buffer_size;
+  uint32_t receive_buffer_size;
+
+  // The options of the accepted sockets. 0 keeps the system default.
+  bool tcp_no_delay;
+
+  // The quick ack mode is not permanent, so it's enabled again after every read.
+  bool tcp_quick_ack;
+  uint32_t tcp_not_sent_lowat;
+  uint32_t busy_poll_us;
+  bool keep_alive;
+  uint32_t keep_alive_idle_sec;
+  uint32_t keep_alive_interval_sec;
+  uint32_t keep_alive_count;
 };
 
 }  // namespace epoll_server
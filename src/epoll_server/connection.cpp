@@ -1,28 +1,88 @@
 #include "epoll_server/connection.h"
 
 #include <unistd.h>
+#include <algorithm>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <sys/errno.h>
 
+#include "epoll_server/event_loop.h"
 #include "epoll_server/logging.h"
 #include "epoll_server/message.h"
+#include "epoll_server/noncopyable.h"
 #include "epoll_server/utils.h"
 #include "epoll_server/config.h"
 
 namespace epoll_server {
 
+// The minimum contiguous space for a recv call.
+static const size_t kMinReadSize = 2048;
+
+// The per thread pool of the outbound queues. A queue returned to the pool is empty but keeps
+// its memory, so the next connection reuses it without allocation.
+template <class Queue>
+class SendQueuePool : private Noncopyable {
+public:
+  // The free queues more than it are freed.
+  static const size_t kMaxFreeQueues = 1024;
+
+  // The pool of the current thread. It's never destroyed, because the connections may be closed
+  // after the thread exits.
+  static SendQueuePool* ThreadLocal() {
+    static thread_local SendQueuePool* pool = new SendQueuePool;
+    return pool;
+  }
+
+  Queue* Get() {
+    if (free_queues_.empty()) {
+      return new Queue;
+    }
+
+    Queue* queue = free_queues_.back();
+    free_queues_.pop_back();
+    return queue;
+  }
+
+  void Put(Queue* queue) {
+    if (free_queues_.size() >= kMaxFreeQueues) {
+      delete queue;
+      return;
+    }
+
+    free_queues_.push_back(queue);
+  }
+
+private:
+  std::vector<Queue*> free_queues_;
+};
+
 Connection::Connection(int fd, Type type)
     : fd_(fd)
     , type_(type)
+    , loop_(nullptr)
     , epoll_events_(0)
-    , timestamp_(0)
+    , edge_triggered_(false)
+    , slot_(0)
+    , generation_(0)
+    , handle_(kInvalidConnectionHandle)
+    , last_active_ms_(0)
+    , partial_since_ms_(0)
+    , remote_addr_(0)
     , remote_port_(-1)
-    , recv_header_(Message::kHeaderLen, 0)
-    , recv_header_len_(0)
-    , recv_data_len_(0)
-    , sended_len_(0) {
+    , read_size_(kMinReadSize)
+    , read_block_size_(BufferPool::kMinBlockSize)
+    , compression_(false)
+    , ordered_(false)
+    , next_request_seq_(1)
+    , next_response_seq_(1)
+    , inflight_requests_(0)
+    , send_queue_(nullptr)
+    , send_offset_(0)
+    , send_bytes_(0)
+    , send_in_flight_(false) {
+  timeout_node_.data = this;
 }
 
 Connection::~Connection() {
@@ -36,22 +96,197 @@ void Connection::Close() {
 
   fd_ = -1;
   type_ = kTypeSocket;
-  timestamp_ = 0;
+  handle_.store(kInvalidConnectionHandle, std::memory_order_release);
   epoll_events_ = 0;
+  edge_triggered_ = false;
+  remote_addr_ = 0;
   remote_ip_.clear();
+  last_active_ms_ = 0;
+  partial_since_ms_ = 0;
   remote_port_ = -1;
-  recv_header_len_ = 0;
-  recv_data_len_ = 0;
-  sended_len_ = 0;
+  read_buffer_.RetrieveAll();
+  read_size_ = kMinReadSize;
+  read_block_size_ = BufferPool::kMinBlockSize;
+  compression_ = false;
+  ordered_ = false;
+  next_request_seq_ = 1;
+  next_response_seq_ = 1;
+  inflight_requests_ = 0;
+  reorder_window_.clear();
+  ReleaseSendQueue();
+  send_offset_ = 0;
+  send_bytes_ = 0;
+  send_in_flight_ = false;
 }
 
-void Connection::SetSendData(std::string&& send_data, size_t sended_len) {
-  send_data_ = std::move(send_data);
-  sended_len_ = sended_len;
+void Connection::AppendSendMessage(MessagePtr msg) {
+  if (msg->file()) {
+    AppendSendFile(std::move(msg));
+    return;
+  }
+
+  if (msg->version() != Message::kVersion2) {
+    if (msg->data.size() > Message::kMaxV1DataLength) {
+      msg = MakeTooLong(*msg, msg->data.size());
+    }
+
+    OutboundMessage& outbound = AppendOutbound();
+    msg->PackHeader(outbound.header);
+    outbound.header_len = Message::kHeaderLen;
+    outbound.offset = 0;
+    outbound.len = static_cast<uint32_t>(msg->data.size());
+    outbound.msg = std::move(msg);
+    send_bytes_ += outbound.size();
+    return;
+  }
+
+  // The chunks are compressed by the worker thread building the response. Only the responses
+  // of the inline routers and the rejected requests are prepared in the I/O thread.
+  msg->PrepareChunks(CONFIG.max_chunk_length, CONFIG.compression_threshold);
+
+  // The chunks but the last one have kFlagMore. The last one has it if more responses follow.
+  const std::vector<Message::Chunk>& chunks = msg->chunks();
+  bool more = msg->more_chunks() || msg->has_more();
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    const Message::Chunk& chunk = chunks[i];
+
+    uint8_t flags = msg->flags() & ~Message::kFlagMore;
+    if (i + 1 < chunks.size() || more) {
+      flags |= Message::kFlagMore;
+    }
+
+    if (!chunk.body.empty()) {
+      flags |= Message::kFlagCompressed;
+    }
+
+    OutboundMessage& outbound = AppendOutbound();
+    msg->PackHeaderV2(outbound.header, flags, chunk.len, chunk.crc32);
+    outbound.header_len = Message::kV2HeaderLen;
+    outbound.offset = chunk.offset;
+    outbound.len = chunk.len;
+    outbound.body = chunk.body.empty() ? nullptr : chunk.body.data();
+    outbound.msg = msg;
+    send_bytes_ += outbound.size();
+  }
+}
+
+void Connection::AppendSendFile(MessagePtr msg) {
+  uint32_t len = msg->file()->length();
+
+  OutboundMessage& outbound = AppendOutbound();
+  if (msg->version() == Message::kVersion2) {
+    uint8_t flags = msg->flags() & Message::kFlagMore;
+    if (msg->has_more()) {
+      flags |= Message::kFlagMore;
+    }
+
+    msg->PackHeaderV2(outbound.header, flags, len, msg->crc32);
+    outbound.header_len = Message::kV2HeaderLen;
+  } else {
+    if (len > Message::kMaxV1DataLength) {
+      msg = MakeTooLong(*msg, len);
+      len = 0;
+    }
+
+    msg->PackHeader(outbound.header);
+    outbound.header_len = Message::kHeaderLen;
+  }
+
+  outbound.offset = 0;
+  outbound.len = len;
+  outbound.msg = std::move(msg);
+  send_bytes_ += outbound.size();
 }
 
-void Connection::UpdateTimestamp() {
-  timestamp_ = GetNowTimestamp();
+MessagePtr Connection::MakeTooLong(const Message& msg, size_t len) const {
+  SPDLOG_WARN("Response is too long for protocol v1. Code: {}, length: {}. Remote addr: {}:{}.",
+              msg.code, len, remote_ip(), remote_port());
+  return Message::Create(msg.conn_handle(), Message::kCodeTooLong, std::string());
+}
+
+const std::string& Connection::remote_ip() const {
+  if (remote_ip_.empty() && remote_addr_ != 0) {
+    remote_ip_ = sock::IpToString(remote_addr_);
+  }
+
+  return remote_ip_;
+}
+
+void Connection::AddInflightRequest(Message* request) {
+  ++inflight_requests_;
+  if (ordered_) {
+    request->set_seq(next_request_seq_++);
+  }
+}
+
+void Connection::AppendResponse(MessagePtr response) {
+  if (!ordered_ || response->seq() == 0) {
+    if (!response->has_more() && inflight_requests_ > 0) {
+      --inflight_requests_;
+    }
+
+    if (!response->placeholder()) {
+      AppendSendMessage(std::move(response));
+    }
+    return;
+  }
+
+  if (response->seq() != next_response_seq_) {
+    reorder_window_[response->seq()].push_back(std::move(response));
+    return;
+  }
+
+  if (!response->placeholder()) {
+    AppendSendMessage(response);
+  }
+
+  if (response->has_more()) {
+    return;
+  }
+
+  // The request is finished. Append the responses of the following requests waiting in the
+  // reorder window.
+  ++next_response_seq_;
+  --inflight_requests_;
+
+  for (;;) {
+    auto it = reorder_window_.begin();
+    if (it == reorder_window_.end() || it->first != next_response_seq_) {
+      break;
+    }
+
+    bool finished = false;
+    for (const MessagePtr& waiting : it->second) {
+      if (!waiting->placeholder()) {
+        AppendSendMessage(waiting);
+      }
+
+      finished = !waiting->has_more();
+    }
+
+    reorder_window_.erase(it);
+
+    // The following responses of the streaming request are appended when they arrive.
+    if (!finished) {
+      break;
+    }
+
+    ++next_response_seq_;
+    --inflight_requests_;
+  }
+}
+
+bool Connection::reading() const {
+  return (epoll_events_ & EPOLLIN) != 0;
+}
+
+void Connection::Activate() {
+  // Skip 0 after wrapping around, so the handle is never invalid.
+  if (++generation_ == 0) {
+    generation_ = 1;
+  }
+
+  handle_.store(MakeConnectionHandle(slot_, generation_), std::memory_order_release);
 }
 
 int Connection::HandleAccept(struct sockaddr_in* sock_addr) {
@@ -65,76 +300,126 @@ int Connection::HandleAccept(struct sockaddr_in* sock_addr) {
    memset(sock_addr, 0, sock_len);
   }
 
-  int fd = accept(fd_, (struct sockaddr*)sock_addr, &sock_len);
+  Poller* poller = CompletionPoller();
+  if (poller != nullptr) {
+    int fd = poller->TakeAccepted(fd_);
+    if (fd != -1 && sock_addr != nullptr) {
+      getpeername(fd, (struct sockaddr*)sock_addr, &sock_len);
+    }
+    return fd;
+  }
+
+  // accept4 sets the flags of the new socket atomically and saves two fcntl calls.
+  int fd = accept4(fd_, (struct sockaddr*)sock_addr, &sock_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
   if (fd != -1) {
     return fd;
   }
 
   // EAGAIN: No data available right now and try again later.
   int err = errno;
-  if (err != EAGAIN && err != EINTR) {
+  if (err != EAGAIN && err != EWOULDBLOCK && err != EINTR) {
     SPDLOG_WARN("Failed to accept socket. Error: {}-{}.", err, strerror(err));
   }
 
   return -1;
 }
 
-bool Connection::HandleRead(MessagePtr* msg) {
+bool Connection::HandleRead(bool* would_block) {
   if (type_ != kTypeSocket) {
     return false;
   }
 
-  // Msg Bytes: DataLen(LittleEndian) + MsgCode(LittleEndian) + CRC32(LittleEndian) + Data.
-  // Receive header.
-  if (recv_header_len_ < Message::kHeaderLen) {
-    int n = sock::Recv(fd_, &recv_header_[0] + recv_header_len_, Message::kHeaderLen - recv_header_len_);
-    if (n < 0) {
-      return false;
-    } else if (n == 0) {
-      return true;
+  if (would_block != nullptr) {
+    *would_block = false;
+  }
+
+  read_buffer_.EnsureWritable(read_size_, read_block_size_);
+  size_t writable = read_buffer_.WritableBytes();
+
+  Poller* poller = CompletionPoller();
+  int n = poller != nullptr ? poller->TakeReceived(fd_, read_buffer_.BeginWrite(), writable)
+                            : sock::Recv(fd_, read_buffer_.BeginWrite(), writable);
+  if (n < 0) {
+    return false;
+  } else if (n == 0) {
+    if (would_block != nullptr) {
+      *would_block = true;
     }
+    return true;
+  }
+
+  read_buffer_.HasWritten(n);
+
+  // More data may be waiting if the block is filled up, so the next block is larger. The next
+  // block of a connection receiving less data is smaller.
+  if (static_cast<size_t>(n) == writable) {
+    read_block_size_ = std::min(read_block_size_ * 4, BufferPool::kBlockSize);
+  } else {
+    read_block_size_ = BufferPool::kMinBlockSize;
+  }
+  return true;
+}
+
+bool Connection::ParseMessage(MessagePtr* msg) {
+  // Msg Bytes: DataLen(LittleEndian) + MsgCode(LittleEndian) + CRC32(LittleEndian) + Data.
+  size_t readable = read_buffer_.ReadableBytes();
+  if (readable < Message::kHeaderLen) {
+    return true;
+  }
+
+  const char* header = read_buffer_.Peek();
+  size_t header_len = Message::kHeaderLen;
+  size_t data_len = BytesToUint16(kLittleEndian, header);
 
-    recv_header_len_ += n;
-    // Header is received partly and continue to read data.
-    if (recv_header_len_ != Message::kHeaderLen) {
+  if (data_len == Message::kV2Magic) {
+    // A frame of protocol v2. Wait for the rest of the header.
+    header_len = Message::kV2HeaderLen;
+    if (readable < header_len) {
+      read_size_ = std::max(kMinReadSize, header_len - readable);
       return true;
     }
 
-    // Header is received completely and calculate the data length.
-    std::uint16_t data_len = BytesToUint16(kLittleEndian, &recv_header_[0]);
-    // Data length is is larger than the maximum packet length. The connection is considered as malicious.
-    if (data_len > CONFIG.max_data_length) {
-      recv_header_len_ = 0;
+    if (static_cast<uint8_t>(header[2]) != Message::kVersion2) {
       return false;
     }
 
-    recv_data_.resize(data_len);
-    return true;
-  }
-
-  // Recveive data.
-  int n = sock::Recv(fd_, &recv_data_[0] + recv_data_len_, recv_data_.size() - recv_data_len_);
-  if (n <= 0) {
+    data_len = BytesToUint32(kLittleEndian, &header[8]);
+    if (data_len > CONFIG.max_chunk_length) {
+      return false;
+    }
+  } else if (data_len > CONFIG.max_data_length) {
+    // Data length is is larger than the maximum packet length. The connection is considered as malicious.
     return false;
-  } else if (n == 0) {
-    return true;
   }
 
-  recv_data_len_ += n;
-  // Body is received completely and calculate the data length.
-  if (recv_data_len_ != recv_data_.size()) {
+  // The message is received partly. Make sure the rest of the message can be read by one recv.
+  size_t msg_len = header_len + data_len;
+  if (readable < msg_len) {
+    read_size_ = std::max(kMinReadSize, msg_len - readable);
     return true;
   }
 
-  // Body is received completely and unpack to message.
+  // The payload refers to the read buffer without copy.
   if (msg != nullptr) {
-    msg->reset(new Message);
-    (*msg)->Unpack(this, &recv_header_[0], std::move(recv_data_));
+    *msg = Message::Create();
+    Slice payload = read_buffer_.MakeSlice(header_len, data_len);
+    if (header_len == Message::kV2HeaderLen) {
+      (*msg)->UnpackV2(this, header, std::move(payload));
+      if ((*msg)->flags() & Message::kFlagAcceptCompression) {
+        compression_ = true;
+      }
+      (*msg)->set_accept_compression(compression_);
+
+      if (!(*msg)->Decompress(CONFIG.max_chunk_length)) {
+        return false;
+      }
+    } else {
+      (*msg)->Unpack(this, header, std::move(payload));
+    }
   }
 
-  recv_header_len_ = 0;
-  recv_data_len_ = 0;
-
+  read_buffer_.Retrieve(msg_len);
+  read_size_ = kMinReadSize;
   return true;
 }
 
@@ -143,19 +428,148 @@ bool Connection::HandleWrite() {
     return false;
   }
 
-  if (send_data_.empty()) {
-    return true;
+  // The send in flight is completed.
+  Poller* poller = CompletionPoller();
+  if (send_in_flight_) {
+    ssize_t n = poller->TakeSent(fd_);
+    if (n < 0) {
+      return false;
+    }
+
+    if (n == 0) {
+      return true;
+    }
+
+    send_in_flight_ = false;
+    RetrieveSendQueue(static_cast<size_t>(n));
   }
 
-  size_t buf_size = send_data_.size() - sended_len_;
-  int n = sock::Send(fd_, &send_data_[0] + sended_len_, buf_size, &sended_len_);
-  // Send data completely.
-  if (n > 0) {
-    return true;
+  // Two buffers per message: the header and the data.
+  const size_t kMaxIovecs = 128;
+  struct iovec iov[kMaxIovecs];
+
+  while (send_queue_ != nullptr) {
+    // The header of the file is sended. Send the rest of the file range.
+    OutboundMessage& front = send_queue_->front();
+    if (front.msg->file() && send_offset_ >= front.header_len) {
+      const FileRange& file = *front.msg->file();
+      size_t file_offset = send_offset_ - front.header_len;
+      ssize_t n = sock::SendFile(fd_, file.fd(), file.offset() + file_offset,
+                                 front.len - file_offset);
+      if (n < 0) {
+        return false;
+      }
+
+      // System write buffer is full. It should wait the writable event.
+      if (n == 0) {
+        return true;
+      }
+
+      RetrieveSendQueue(static_cast<size_t>(n));
+      continue;
+    }
+
+    // Gather the messages until a file, whose header is the last buffer.
+    size_t iov_count = 0;
+    size_t offset = send_offset_;
+    bool more = false;
+    for (auto it = send_queue_->begin(); it != send_queue_->end() && iov_count + 2 <= kMaxIovecs;
+         ++it) {
+      if (offset < it->header_len) {
+        iov[iov_count].iov_base = it->header + offset;
+        iov[iov_count].iov_len = it->header_len - offset;
+        ++iov_count;
+        offset = 0;
+      } else {
+        offset -= it->header_len;
+      }
+
+      if (it->msg->file()) {
+        more = it->len > 0;
+        break;
+      }
+
+      if (it->len > offset) {
+        const char* data = it->body == nullptr ? &it->msg->data[it->offset] : it->body;
+        iov[iov_count].iov_base = const_cast<char*>(data) + offset;
+        iov[iov_count].iov_len = it->len - offset;
+        ++iov_count;
+      }
+
+      offset = 0;
+    }
+
+    // The queue is retrieved after the send is completed.
+    if (poller != nullptr) {
+      if (!poller->Send(fd_, iov, iov_count, more)) {
+        return false;
+      }
+
+      send_in_flight_ = true;
+      return true;
+    }
+
+    ssize_t n = sock::Sendv(fd_, iov, iov_count, more);
+    if (n < 0) {
+      return false;
+    }
+
+    // System write buffer is full. It should wait the writable event.
+    if (n == 0) {
+      return true;
+    }
+
+    RetrieveSendQueue(static_cast<size_t>(n));
+  }
+
+  return true;
+}
+
+void Connection::RetrieveSendQueue(size_t sended_len) {
+  // Pop the messages sended completely and record the offset of the message sended partly.
+  send_bytes_ -= sended_len;
+  while (sended_len > 0) {
+    size_t front_len = send_queue_->front().size() - send_offset_;
+    if (sended_len < front_len) {
+      send_offset_ += sended_len;
+      break;
+    }
+
+    sended_len -= front_len;
+    send_queue_->pop_front();
+    send_offset_ = 0;
+  }
+
+  if (send_queue_->empty()) {
+    ReleaseSendQueue();
+  }
+}
+
+Connection::OutboundMessage& Connection::AppendOutbound() {
+  if (send_queue_ == nullptr) {
+    send_queue_ = SendQueuePool<SendQueue>::ThreadLocal()->Get();
+  }
+
+  send_queue_->emplace_back();
+  return send_queue_->back();
+}
+
+void Connection::ReleaseSendQueue() {
+  if (send_queue_ == nullptr) {
+    return;
+  }
+
+  send_queue_->clear();
+  SendQueuePool<SendQueue>::ThreadLocal()->Put(send_queue_);
+  send_queue_ = nullptr;
+}
+
+Poller* Connection::CompletionPoller() const {
+  if (loop_ == nullptr || loop_->poller() == nullptr || !loop_->poller()->CompletionBased()) {
+    return nullptr;
   }
 
-  // Failed to send data or send data partly.
-  return false;
+  return loop_->poller();
 }
 
 void Connection::HandleWakeUp() {
@@ -176,6 +590,10 @@ void Connection::SetReadEvent(bool enable) {
   } else {
     epoll_events_ &= ~(EPOLLIN | EPOLLRDHUP);
   }
+
+  if (edge_triggered_) {
+    epoll_events_ |= EPOLLET;
+  }
 }
 
 void Connection::SetWriteEvent(bool enable) {
@@ -184,6 +602,10 @@ void Connection::SetWriteEvent(bool enable) {
   } else {
     epoll_events_ &= ~EPOLLOUT;
   }
+
+  if (edge_triggered_) {
+    epoll_events_ |= EPOLLET;
+  }
 }
 
 }  // namespace epoll_server
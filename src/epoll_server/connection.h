@@ -1,15 +1,25 @@
 #ifndef EPOLL_SERVER_CONNECTION_H_
 #define EPOLL_SERVER_CONNECTION_H_
 
+#include <atomic>
+#include <deque>
+#include <map>
+#include <vector>
 #include <string>
 #include <functional>
 
+#include "epoll_server/buffer.h"
+#include "epoll_server/connection_table.h"
 #include "epoll_server/message.h"
+#include "epoll_server/timeout_wheel.h"
 
 struct sockaddr_in;
 
 namespace epoll_server {
 
+class EventLoop;
+class Poller;
+
 class Connection {
 public:
   enum Type {
@@ -41,22 +51,61 @@ public:
     type_ = type;
   }
 
+  // The event loop which the connection belongs to. It never changes after the connection
+  // is created, so it's safe to read it in any thread.
+  EventLoop* loop() const {
+    return loop_;
+  }
+
+  void set_loop(EventLoop* loop) {
+    loop_ = loop;
+  }
+
   uint32_t epoll_events() const {
     return epoll_events_;
   }
 
-  int64_t timestamp() const {
-    return timestamp_;
+  // The socket is registered with EPOLLET if edge triggered. The read events must be drained
+  // until EAGAIN, otherwise epoll will not notify the left data again.
+  bool edge_triggered() const {
+    return edge_triggered_;
+  }
+
+  void set_edge_triggered(bool edge_triggered) {
+    edge_triggered_ = edge_triggered;
   }
 
-  void set_remote_ip(const std::string& remote_ip) {
-    remote_ip_ = remote_ip;
+  // The handle of the connection in the connection table. It's kInvalidConnectionHandle after
+  // closing. It can be read in any thread to check whether the connection is closed or reused.
+  ConnectionHandle handle() const {
+    return handle_.load(std::memory_order_acquire);
+  }
+
+  // The slot in the connection table. It never changes.
+  uint32_t slot() const {
+    return slot_;
+  }
+
+  void set_slot(uint32_t slot) {
+    slot_ = slot;
+  }
+
+  // Increase the generation of the slot and publish the new handle. It's called when the
+  // connection is taken from the pool.
+  void Activate();
+
+  // Remote address is in network byte order.
+  void set_remote_addr(uint32_t remote_addr) {
+    remote_addr_ = remote_addr;
   }
 
-  const std::string& remote_ip() const {
-    return remote_ip_;
+  uint32_t remote_addr() const {
+    return remote_addr_;
   }
 
+  // The remote ip string is formatted at the first call, not at accepting.
+  const std::string& remote_ip() const;
+
   void set_remote_port(unsigned short remote_port) {
     remote_port_ = remote_port;
   }
@@ -65,17 +114,98 @@ public:
     return remote_port_;
   }
 
-  void SetSendData(std::string&& send_data, size_t sended_len);
+  // Append the message to the end of the outbound queue. The message is sended by
+  // HandleWrite() without packing into a contiguous buffer. A message of protocol v2 longer
+  // than max_chunk_length is split into chunks.
+  void AppendSendMessage(MessagePtr msg);
+
+  // In ordered response mode, the responses are sended strictly in the order of requests.
+  bool ordered() const {
+    return ordered_;
+  }
 
-  void UpdateTimestamp();
+  void set_ordered(bool ordered) {
+    ordered_ = ordered;
+  }
+
+  // Count the request as in flight until its response is appended. In ordered response mode,
+  // the request is tagged with the next sequence number.
+  void AddInflightRequest(Message* request);
+
+  // The count of requests whose responses are not appended to the outbound queue yet.
+  size_t InflightRequests() const {
+    return inflight_requests_;
+  }
+
+  // Append the response to the outbound queue. In ordered response mode, the response waits in
+  // the reorder window until the responses of all the previous requests are appended.
+  // Every request should have exactly one last response, which may be a placeholder. The
+  // responses with has_more are streamed before the last one.
+  void AppendResponse(MessagePtr response);
+
+  bool reading() const;
+
+  bool HasSendData() const {
+    return send_queue_ != nullptr;
+  }
+
+  // Some data is left to send and no send is in flight, so the socket should be polled for
+  // writable.
+  bool WaitingWritable() const {
+    return send_queue_ != nullptr && !send_in_flight_;
+  }
 
-  // Return socket fd.
+  // The bytes in the outbound queue not sended yet.
+  size_t send_bytes() const {
+    return send_bytes_;
+  }
+
+  // The idle and partial frame timeouts of the connection in the time wheel of its loop.
+  TimeoutNode* timeout_node() {
+    return &timeout_node_;
+  }
+
+  // The last time when some data is received or sended.
+  int64_t last_active_ms() const {
+    return last_active_ms_;
+  }
+
+  void set_last_active_ms(int64_t last_active_ms) {
+    last_active_ms_ = last_active_ms;
+  }
+
+  // The time when the first bytes of the uncompleted message are received. 0 means no
+  // uncompleted message.
+  int64_t partial_since_ms() const {
+    return partial_since_ms_;
+  }
+
+  void set_partial_since_ms(int64_t partial_since_ms) {
+    partial_since_ms_ = partial_since_ms;
+  }
+
+  // Some bytes of an uncompleted message are left in the read buffer.
+  bool HasPartialMessage() const {
+    return read_buffer_.ReadableBytes() > 0;
+  }
+
+  // Return non-blocking and close-on-exec socket fd.
+  // Return -1 if no pending connection or some errors occurred.
   int HandleAccept(struct sockaddr_in* sock_addr);
 
-  // Inititalize msg if recieved a completed message.
+  // Receive data into the read buffer with one recv call.
+  // Set would_block to be true if no more data is available right now.
   // Return false if client closed or some read errors occurred.
-  bool HandleRead(MessagePtr* msg);
+  bool HandleRead(bool* would_block = nullptr);
+
+  // Inititalize msg if a completed message is in the read buffer.
+  // Return false if the message is invalid.
+  bool ParseMessage(MessagePtr* msg);
 
+  // Gather write the outbound queue until it's empty or EAGAIN. With the completion based
+  // poller, the gather write is submitted to the poller and the queue is retrieved at the next
+  // call after it's completed.
+  // Return false if some write errors occurred.
   bool HandleWrite();
 
   void HandleWakeUp();
@@ -83,26 +213,102 @@ public:
   void SetReadEvent(bool enable);
   void SetWriteEvent(bool enable);
 
+private:
+  // Append the response of file range. It's sended by sendfile after its header.
+  void AppendSendFile(MessagePtr msg);
+
+  // Return the empty response with Message::kCodeTooLong, which is sended instead of the v1
+  // response of len bytes. So the client is not waiting and the reorder window moves on.
+  MessagePtr MakeTooLong(const Message& msg, size_t len) const;
+
+  // Remove the sended bytes from the outbound queue. The queue is returned to the pool after
+  // all the messages are sended.
+  void RetrieveSendQueue(size_t sended_len);
+
+  // Append an empty message to the outbound queue, which is borrowed from the pool if the
+  // connection has nothing to send.
+  struct OutboundMessage;
+  OutboundMessage& AppendOutbound();
+
+  // Return the empty outbound queue to the pool.
+  void ReleaseSendQueue();
+
+  // The poller of the loop if it accepts, receives and sends by itself. Otherwise nullptr.
+  Poller* CompletionPoller() const;
+
 private:
   int fd_;
   Type type_;
 
+  EventLoop* loop_;
+
   uint32_t epoll_events_;
+  bool edge_triggered_;
 
-  // Every alive connection has a unique timestamp.
-  int64_t timestamp_;  // Millsecond.
+  uint32_t slot_;
+  uint32_t generation_;
+  std::atomic<ConnectionHandle> handle_;
 
-  std::string remote_ip_;
-  unsigned short remote_port_;
+  TimeoutNode timeout_node_;
+  int64_t last_active_ms_;
+  int64_t partial_since_ms_;
 
-  std::string recv_header_;
-  size_t recv_header_len_;
+  uint32_t remote_addr_;
+  mutable std::string remote_ip_;
+  unsigned short remote_port_;
 
-  std::string recv_data_;
-  size_t recv_data_len_;
+  // The received data not parsed to messages yet. A recv call reads into all the writable space
+  // of the buffer block, which is at least read_size_ bytes, the rest of the partly received
+  // message. The block is borrowed only while some data is not parsed.
+  Buffer read_buffer_;
+  size_t read_size_;
+
+  // The size of a new read block. It starts from the smallest size class, and grows while the
+  // recv calls fill up the blocks.
+  size_t read_block_size_;
+
+  // The client accepts compressed responses.
+  bool compression_;
+
+  bool ordered_;
+  uint64_t next_request_seq_;
+  uint64_t next_response_seq_;
+  size_t inflight_requests_;
+
+  // The responses arrived before the responses of their previous requests. The key is the
+  // sequence number. A streaming request may have several responses.
+  std::map<uint64_t, std::vector<MessagePtr>> reorder_window_;
+
+  // A message or a chunk of a message in the outbound queue. The header and the data are sended
+  // by one gather write.
+  struct OutboundMessage {
+    MessagePtr msg;
+    char header[Message::kV2HeaderLen];
+    uint32_t header_len;
+
+    // The range of the message data.
+    uint32_t offset;
+    uint32_t len;
+
+    // The compressed chunk of the message which is sended instead of the range of data.
+    const char* body;
+
+    size_t size() const {
+      return header_len + len;
+    }
+  };
 
-  std::string send_data_;
-  size_t sended_len_;
+  // The outbound queue. The front message may be sended partly. It's borrowed from the pool of
+  // the I/O thread while some messages are not sended, so an idle connection holds no memory of
+  // it.
+  using SendQueue = std::deque<OutboundMessage>;
+  SendQueue* send_queue_;
+  size_t send_offset_;
+  size_t send_bytes_;
+
+  // A gather write submitted to the completion based poller is not completed. The buffers of
+  // the outbound queue are kept until then.
+  bool send_in_flight_;
 };
 
 }  // namespace epoll_server
@@ -1,20 +1,23 @@
 #include "epoll_server/connection_pool.h"
 
 #include "epoll_server/connection.h"
+#include "epoll_server/connection_table.h"
 
 namespace epoll_server {
 
-ConnectionPool::ConnectionPool(size_t size) {
-  for (std::size_t i = 0; i < size; ++i) {
-    pool_.push_back(new Connection);
+bool ConnectionPool::Init(size_t size, EventLoop* loop) {
+  uint32_t first_slot = 0;
+  if (!ConnectionTable::GetInstance()->Reserve(size, loop, &first_slot)) {
+    return false;
   }
-}
 
-ConnectionPool::~ConnectionPool() {
-  for (Connection* conn : pool_) {
-    delete conn;
+  // Pushed in reverse order, so the connections are taken from the first slot.
+  free_slots_.reserve(size);
+  for (size_t i = size; i > 0; --i) {
+    free_slots_.push_back(first_slot + static_cast<uint32_t>(i - 1));
   }
-  pool_.clear();
+
+  return true;
 }
 
 Connection* ConnectionPool::Get() {
@@ -22,14 +25,10 @@ Connection* ConnectionPool::Get() {
     return nullptr;
   }
 
-  Connection* conn = pool_.front();
-  if (conn == nullptr) {
-    return nullptr;
-  }
-
-  conn->UpdateTimestamp();
+  Connection* conn = ConnectionTable::GetInstance()->At(free_slots_.back());
+  free_slots_.pop_back();
 
-  pool_.pop_front();
+  conn->Activate();
   return conn;
 }
 
@@ -40,15 +39,15 @@ void ConnectionPool::Release(Connection* conn) {
 
   conn->Close();
 
-  pool_.push_back(conn);
+  free_slots_.push_back(conn->slot());
 }
 
 size_t ConnectionPool::Size() const {
-  return pool_.size();
+  return free_slots_.size();
 }
 
 bool ConnectionPool::Empty() const {
-  return pool_.empty();
+  return free_slots_.empty();
 }
 
-}  // namespace epoll_server
\ No newline at end of file
+}  // namespace epoll_server
@@ -1,19 +1,28 @@
 #ifndef EPOLL_SERVER_CONNECTION_POOL_H_
 #define EPOLL_SERVER_CONNECTION_POOL_H_
 
-#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "epoll_server/noncopyable.h"
 
 namespace epoll_server {
 
 class Connection;
+class EventLoop;
 
+// The free connections of an event loop. The connections are in the slots reserved from the
+// connection table.
 class ConnectionPool : private Noncopyable {
 public:
-  ConnectionPool(size_t size);
-  ~ConnectionPool();
+  ConnectionPool() = default;
 
+  // All the connections belong to the given event loop.
+  // Return false if the connection table has not enough slots.
+  bool Init(size_t size, EventLoop* loop = nullptr);
+
+  // The connection gets a new handle.
   Connection* Get();
 
   void Release(Connection* conn);
@@ -23,7 +32,9 @@ public:
   bool Empty() const;
 
 private:
-  std::deque<Connection*> pool_;
+  // The stack of free slots. The last released connection is reused first, while its memory is
+  // still in the cache.
+  std::vector<uint32_t> free_slots_;
 };
 
 }  // namespace epoll_server
@@ -0,0 +1,67 @@
+#include "epoll_server/connection_table.h"
+
+#include "epoll_server/connection.h"
+#include "epoll_server/logging.h"
+
+namespace epoll_server {
+
+ConnectionTable::ConnectionTable() : size_(0), reserved_(0) {
+}
+
+ConnectionTable::~ConnectionTable() = default;
+
+void ConnectionTable::Init(size_t size) {
+  // The slot is 32 bits.
+  if (size > UINT32_MAX) {
+    size = UINT32_MAX;
+  }
+
+  slab_.reset(new Connection[size]);
+  size_ = size;
+  reserved_ = 0;
+
+  for (size_t i = 0; i < size; ++i) {
+    slab_[i].set_slot(static_cast<uint32_t>(i));
+  }
+}
+
+bool ConnectionTable::Reserve(size_t count, EventLoop* loop, uint32_t* first_slot) {
+  if (count > size_ - reserved_) {
+    SPDLOG_ERROR("Not enough connection slots. Size: {}, reserved: {}, required: {}.", size_,
+                 reserved_, count);
+    return false;
+  }
+
+  for (size_t i = reserved_; i < reserved_ + count; ++i) {
+    slab_[i].set_loop(loop);
+  }
+
+  *first_slot = static_cast<uint32_t>(reserved_);
+  reserved_ += count;
+  return true;
+}
+
+Connection* ConnectionTable::At(uint32_t slot) const {
+  return &slab_[slot];
+}
+
+Connection* ConnectionTable::Find(ConnectionHandle handle) const {
+  uint32_t slot = GetConnectionSlot(handle);
+  if (handle == kInvalidConnectionHandle || slot >= size_) {
+    return nullptr;
+  }
+
+  Connection* conn = &slab_[slot];
+  return conn->handle() == handle ? conn : nullptr;
+}
+
+EventLoop* ConnectionTable::GetLoop(ConnectionHandle handle) const {
+  uint32_t slot = GetConnectionSlot(handle);
+  if (handle == kInvalidConnectionHandle || slot >= size_) {
+    return nullptr;
+  }
+
+  return slab_[slot].loop();
+}
+
+}  // namespace epoll_server
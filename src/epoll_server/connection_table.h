@@ -0,0 +1,77 @@
+#ifndef EPOLL_SERVER_CONNECTION_TABLE_H_
+#define EPOLL_SERVER_CONNECTION_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "epoll_server/singleton_base.h"
+
+namespace epoll_server {
+
+class Connection;
+class EventLoop;
+
+// A connection is referred by a 64-bit handle: Generation(32 bits) << 32 | Slot(32 bits).
+// The slot is the index of the connection in the connection table, and the generation is
+// increased every time the slot is reused. So a handle never refers to a later connection of the
+// same slot, whatever the accept rate is.
+using ConnectionHandle = uint64_t;
+
+// The generation starts from 1, so no connection has the invalid handle.
+const ConnectionHandle kInvalidConnectionHandle = 0;
+
+inline ConnectionHandle MakeConnectionHandle(uint32_t slot, uint32_t generation) {
+  return static_cast<ConnectionHandle>(generation) << 32 | slot;
+}
+
+inline uint32_t GetConnectionSlot(ConnectionHandle handle) {
+  return static_cast<uint32_t>(handle);
+}
+
+inline uint32_t GetConnectionGeneration(ConnectionHandle handle) {
+  return static_cast<uint32_t>(handle >> 32);
+}
+
+// The connections of all the event loops are stored in one contiguous slab indexed by slot.
+// Every event loop reserves a range of slots for its connection pool. The slab is never
+// reallocated, so a handle is resolved by an index and a comparison in any thread.
+
+class ConnectionTable : public SingletonBase<ConnectionTable> {
+public:
+  ~ConnectionTable();
+
+  // Allocate the slab. It should be called once before the connection pools are initialized.
+  void Init(size_t size);
+
+  // Reserve count slots for the connections of the loop.
+  // Return false if not enough slots are left.
+  bool Reserve(size_t count, EventLoop* loop, uint32_t* first_slot);
+
+  Connection* At(uint32_t slot) const;
+
+  // Thread safe. Return nullptr if the connection is closed or the slot is reused. The returned
+  // connection can only be used in the I/O thread of its loop.
+  Connection* Find(ConnectionHandle handle) const;
+
+  // Thread safe. Return the event loop of the slot, which never changes.
+  EventLoop* GetLoop(ConnectionHandle handle) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+private:
+  ConnectionTable();
+
+  friend class SingletonBase<ConnectionTable>;
+
+private:
+  std::unique_ptr<Connection[]> slab_;
+  size_t size_;
+  size_t reserved_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_CONNECTION_TABLE_H_
@@ -1,5 +1,14 @@
 #include "epoll_server/crc32.h"
 
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define EPOLL_SERVER_CRC32_PCLMUL 1
+#endif
+
 namespace epoll_server {
 
 static const unsigned int kCrc32Table[] = {
@@ -48,22 +57,301 @@ static const unsigned int kCrc32Table[] = {
   0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
-unsigned int CalcCRC32(const std::string& data_bytes) {
-  if (data_bytes.empty()) {
-    return 0;
+// The tables of slice-by-N. tables[0] is kCrc32Table. tables[k][i] is the CRC of byte i
+// followed by k zero bytes.
+struct Crc32Tables {
+  uint32_t tables[16][256];
+
+  Crc32Tables() {
+    for (int i = 0; i < 256; ++i) {
+      tables[0][i] = kCrc32Table[i];
+    }
+
+    for (int k = 1; k < 16; ++k) {
+      for (int i = 0; i < 256; ++i) {
+        uint32_t crc = tables[k - 1][i];
+        tables[k][i] = (crc >> 8) ^ kCrc32Table[crc & 0xFF];
+      }
+    }
   }
+};
+
+static const Crc32Tables kCrc32Tables;
+
+static inline uint32_t LoadUint32(const unsigned char* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
 
-  int size = static_cast<int>(data_bytes.size());
-  unsigned int crc = 0;
-  const unsigned char *p = reinterpret_cast<const unsigned char*>(&data_bytes[0]);
-  crc = crc ^ ~0U;
+// The crc arguments and return values of the kernels are not inverted.
 
+static uint32_t Crc32Bytewise(uint32_t crc, const unsigned char* p, size_t size) {
   while (size > 0) {
     crc = kCrc32Table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
     size--;
   }
 
-  return crc ^ ~0U;
+  return crc;
+}
+
+static uint32_t Crc32SliceBy8(uint32_t crc, const unsigned char* p, size_t size) {
+  const uint32_t (*t)[256] = kCrc32Tables.tables;
+
+  while (size >= 8) {
+    uint32_t one = LoadUint32(p) ^ crc;
+    uint32_t two = LoadUint32(p + 4);
+
+    crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^
+          t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^
+          t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^
+          t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+
+    p += 8;
+    size -= 8;
+  }
+
+  return Crc32Bytewise(crc, p, size);
+}
+
+static uint32_t Crc32SliceBy16(uint32_t crc, const unsigned char* p, size_t size) {
+  const uint32_t (*t)[256] = kCrc32Tables.tables;
+
+  while (size >= 16) {
+    uint32_t one = LoadUint32(p) ^ crc;
+    uint32_t two = LoadUint32(p + 4);
+    uint32_t three = LoadUint32(p + 8);
+    uint32_t four = LoadUint32(p + 12);
+
+    crc = t[15][one & 0xFF] ^ t[14][(one >> 8) & 0xFF] ^
+          t[13][(one >> 16) & 0xFF] ^ t[12][one >> 24] ^
+          t[11][two & 0xFF] ^ t[10][(two >> 8) & 0xFF] ^
+          t[9][(two >> 16) & 0xFF] ^ t[8][two >> 24] ^
+          t[7][three & 0xFF] ^ t[6][(three >> 8) & 0xFF] ^
+          t[5][(three >> 16) & 0xFF] ^ t[4][three >> 24] ^
+          t[3][four & 0xFF] ^ t[2][(four >> 8) & 0xFF] ^
+          t[1][(four >> 16) & 0xFF] ^ t[0][four >> 24];
+
+    p += 16;
+    size -= 16;
+  }
+
+  return Crc32SliceBy8(crc, p, size);
+}
+
+#ifdef EPOLL_SERVER_CRC32_PCLMUL
+
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel, 2009.
+// The constants are of the bit-reflected domain.
+// Fold the 16 * n bytes (n >= 4) of p into the crc.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t Crc32PclmulFold(uint32_t crc, const unsigned char* p, size_t size) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+  x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+  x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+  x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+
+  p += 64;
+  size -= 64;
+
+  // Fold 4 blocks of 16 bytes in parallel.
+  while (size >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30)));
+
+    p += 64;
+    size -= 64;
+  }
+
+  // Fold the 4 blocks into one.
+  x0 = k3k4;
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // Fold the left blocks of 16 bytes.
+  while (size >= 16) {
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    p += 16;
+    size -= 16;
+  }
+
+  // Fold 128 bits to 64 bits.
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits.
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static uint32_t Crc32Pclmul(uint32_t crc, const unsigned char* p, size_t size) {
+  if (size >= 64) {
+    size_t fold_size = size & ~static_cast<size_t>(15);
+    crc = Crc32PclmulFold(crc, p, fold_size);
+    p += fold_size;
+    size -= fold_size;
+  }
+
+  return Crc32SliceBy8(crc, p, size);
+}
+
+static bool HasPclmul() {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+    return false;
+  }
+
+  return (ecx & bit_PCLMUL) != 0 && (ecx & bit_SSE4_1) != 0;
+}
+
+#endif  // EPOLL_SERVER_CRC32_PCLMUL
+
+using Crc32Function = uint32_t (*)(uint32_t crc, const unsigned char* p, size_t size);
+
+static Crc32Kernel ChooseCrc32Kernel() {
+#ifdef EPOLL_SERVER_CRC32_PCLMUL
+  if (HasPclmul()) {
+    return kCrc32Pclmul;
+  }
+#endif
+
+  return kCrc32SliceBy8;
+}
+
+static Crc32Function GetCrc32Function(Crc32Kernel kernel) {
+  switch (kernel) {
+    case kCrc32SliceBy8:
+      return Crc32SliceBy8;
+    case kCrc32SliceBy16:
+      return Crc32SliceBy16;
+#ifdef EPOLL_SERVER_CRC32_PCLMUL
+    case kCrc32Pclmul:
+      return Crc32Pclmul;
+#endif
+    default:
+      return Crc32Bytewise;
+  }
+}
+
+static const Crc32Kernel kCrc32Kernel = ChooseCrc32Kernel();
+static const Crc32Function kCrc32Function = GetCrc32Function(kCrc32Kernel);
+
+Crc32Kernel GetCrc32Kernel() {
+  return kCrc32Kernel;
+}
+
+bool IsCrc32KernelSupported(Crc32Kernel kernel) {
+  switch (kernel) {
+    case kCrc32Bytewise:
+    case kCrc32SliceBy8:
+    case kCrc32SliceBy16:
+      return true;
+#ifdef EPOLL_SERVER_CRC32_PCLMUL
+    case kCrc32Pclmul:
+      return HasPclmul();
+#endif
+    default:
+      return false;
+  }
+}
+
+const char* GetCrc32KernelName(Crc32Kernel kernel) {
+  switch (kernel) {
+    case kCrc32Bytewise:
+      return "bytewise";
+    case kCrc32SliceBy8:
+      return "slice-by-8";
+    case kCrc32SliceBy16:
+      return "slice-by-16";
+    case kCrc32Pclmul:
+      return "pclmul";
+    default:
+      return "unknown";
+  }
+}
+
+unsigned int CalcCRC32(const std::string& data_bytes) {
+  return CalcCRC32(data_bytes.data(), data_bytes.size());
+}
+
+unsigned int CalcCRC32(const char* data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  return kCrc32Function(~0U, p, size) ^ ~0U;
+}
+
+unsigned int ExtendCRC32(unsigned int crc, const char* data, size_t size) {
+  if (size == 0) {
+    return crc;
+  }
+
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  return kCrc32Function(crc ^ ~0U, p, size) ^ ~0U;
+}
+
+unsigned int CalcCRC32(Crc32Kernel kernel, const char* data, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  return GetCrc32Function(kernel)(~0U, p, size) ^ ~0U;
 }
 
 }  // namespace epoll_server
@@ -1,11 +1,41 @@
 #ifndef EPOLL_SERVER_CRC32_H_
 #define EPOLL_SERVER_CRC32_H_
 
+#include <cstddef>
 #include <string>
 
 namespace epoll_server {
 
+// The kernels of CRC32 (IEEE polynomial). All of them return the same value.
+enum Crc32Kernel {
+  kCrc32Bytewise = 0,
+  kCrc32SliceBy8,
+  kCrc32SliceBy16,
+
+  // Fold 64 bytes per iteration by carry-less multiplication. The tail less than 16 bytes is
+  // calculated by slice-by-8. Requires PCLMULQDQ and SSE4.1.
+  kCrc32Pclmul,
+
+  kCrc32KernelCount
+};
+
+// The fastest kernel supported by the CPU. It's chosen through CPUID at startup, and used by
+// CalcCRC32().
+Crc32Kernel GetCrc32Kernel();
+
+bool IsCrc32KernelSupported(Crc32Kernel kernel);
+
+const char* GetCrc32KernelName(Crc32Kernel kernel);
+
 unsigned int CalcCRC32(const std::string& data_bytes);
+unsigned int CalcCRC32(const char* data, size_t size);
+
+// Continue the CRC32 of the previous bytes with the following bytes:
+// ExtendCRC32(CalcCRC32(a), b) == CalcCRC32(a + b).
+unsigned int ExtendCRC32(unsigned int crc, const char* data, size_t size);
+
+// Calculate by the given kernel, which should be supported.
+unsigned int CalcCRC32(Crc32Kernel kernel, const char* data, size_t size);
 
 }  // namespace epoll_server
 
@@ -83,4 +83,13 @@ bool Epoller::Modify(int target_fd, uint32_t events, void* ptr) {
   return true;
 }
 
+bool Epoller::Remove(int target_fd) {
+  if (epoll_ctl(fd_, EPOLL_CTL_DEL, target_fd, nullptr) == -1) {
+    SPDLOG_ERROR("Failed to remove epoll event. Error:{}-{}.", errno, strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace epoll_server
@@ -3,31 +3,35 @@
 
 #include <sys/epoll.h>
 
-namespace epoll_server {
+#include "epoll_server/poller.h"
 
-const size_t kMaxEpollEvents = 1024;
+namespace epoll_server {
 
-class Epoller {
+class Epoller : public Poller {
 public:
   Epoller();
-  ~Epoller();
+  ~Epoller() override;
 
-  bool Create();
+  bool Create() override;
 
   // waiting_ms > 0: Waiting timeout.
   // waiting_ms = 0: Return immediately.
   // waiting_ms = -1: Block until receive evets.
   // Return >= 0: Received events count.
   // Return < 0: Error.
-  int Poll(int waiting_ms = -1);
+  int Poll(int waiting_ms = -1) override;
 
-  const struct epoll_event& GetEvent(size_t index) const;
+  const struct epoll_event& GetEvent(size_t index) const override;
 
   // Register the target fd on the epoll instance.
-  bool Add(int target_fd, uint32_t events, void* ptr);
+  bool Add(int target_fd, uint32_t events, void* ptr) override;
 
   // Change the the event of target fd.
-  bool Modify(int target_fd, uint32_t events, void* ptr);
+  bool Modify(int target_fd, uint32_t events, void* ptr) override;
+
+  // Unregister the target fd by EPOLL_CTL_DEL. Closing the fd removes it too, unless the file
+  // is still referred by another fd, so it's removed explicitly before the fd is closed.
+  bool Remove(int target_fd) override;
 
 private:
   int fd_;
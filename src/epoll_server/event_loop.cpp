@@ -0,0 +1,615 @@
+#include "epoll_server/event_loop.h"
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "epoll_server/config.h"
+#include "epoll_server/connection_table.h"
+#include "epoll_server/logging.h"
+#include "epoll_server/socket_options.h"
+#include "epoll_server/utils.h"
+
+namespace epoll_server {
+
+// 512 slots of 100 ms cover 51.2 seconds. The longer timeouts wait for several rounds. The loop
+// wakes up at every tick while some timeouts are scheduled.
+static const uint32_t kTimeoutWheelSlots = 512;
+static const uint32_t kTimeoutTickMs = 100;
+
+EventLoop::EventLoop()
+    : wakener_fd_(-1)
+    , now_ms_(GetNowTimestamp())
+    , timeout_wheel_(kTimeoutWheelSlots, kTimeoutTickMs)
+    , spin_deadline_us_(0)
+    , spinning_(false)
+    , spin_hits_(0)
+    , wasted_spins_(0)
+    , wakeup_pending_(false)
+    , quit_(false) {
+}
+
+bool EventLoop::Init(int acceptor_fd, size_t connection_pool_size) {
+  SPDLOG_TRACK_METHOD;
+
+  connection_pool_.reset(new ConnectionPool);
+  if (!connection_pool_->Init(connection_pool_size, this)) {
+    return false;
+  }
+
+  poller_ = CreatePoller(CONFIG.io_backend);
+  if (!poller_) {
+    return false;
+  }
+
+  acceptor_connection_.reset(new Connection(acceptor_fd, Connection::kTypeAcceptor));
+  acceptor_connection_->set_loop(this);
+  acceptor_connection_->SetReadEvent(true);
+  if (!poller_->AddAcceptor(acceptor_connection_->fd(),
+      static_cast<void*>(acceptor_connection_.get()))) {
+    return false;
+  }
+
+  wakener_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakener_fd_ == -1) {
+    SPDLOG_ERROR("Failed to create eventfd instance.");
+    return false;
+  }
+
+  wakener_connection_.reset(new Connection(wakener_fd_, Connection::kTypeWakener));
+  wakener_connection_->set_loop(this);
+  wakener_connection_->SetReadEvent(true);
+  if (!poller_->Add(wakener_connection_->fd(), wakener_connection_->epoll_events(),
+      static_cast<void*>(wakener_connection_.get()))) {
+    return false;
+  }
+
+  return true;
+}
+
+void EventLoop::Loop() {
+  while (!quit_.load()) {
+    if (!PollOnce()) {
+      return;
+    }
+  }
+}
+
+void EventLoop::Quit() {
+  quit_.store(true);
+
+  // The spinning loop checks the flag without waking up too.
+  WakeUp();
+}
+
+bool EventLoop::PollOnce() {
+  std::vector<ConnectionHandle> unfinished_reads;
+  unfinished_reads.swap(unfinished_reads_);
+
+  // Don't block if some connections still have data to read or some responses are being pushed.
+  // Otherwise wake up at the next tick of the time wheel if some timeouts are waiting.
+  bool blocking = unfinished_reads.empty() && pending_responses_.Empty();
+
+  // Spin instead of blocking if some events were handled recently. The responses pushed before
+  // the spinning stops are checked again.
+  bool spinning = false;
+  if (blocking && CONFIG.spin_poll_us > 0) {
+    spinning = UpdateSpinning();
+    blocking = !spinning && pending_responses_.Empty();
+  }
+
+  int n = poller_->Poll(blocking ? timeout_wheel_.NextTickMs(now_ms_) : 0);
+  if (n == -1 ) {
+    return false;
+  }
+
+  now_ms_ = GetNowTimestamp();
+
+  for (int i = 0; i < n; ++i) {
+    auto event = poller_->GetEvent(i);
+    Connection* conn = static_cast<Connection*>(event.data.ptr);
+    if (conn == nullptr) {
+      SPDLOG_WARN("Unexpected epoll event.");
+      continue;
+    }
+
+    // The connection may be closed by preivous event.
+    if (conn->fd() == -1) {
+      SPDLOG_DEBUG("Expired event.");
+      continue;
+    }
+
+    // EPOLLERR and EPOLLHUP are reported even if the reading is paused. The socket can't be
+    // read or written any more.
+    if (conn->type() == Connection::kTypeSocket && !conn->reading() &&
+        (event.events & (EPOLLERR | EPOLLHUP))) {
+      if (on_disconnected_) {
+        on_disconnected_(conn);
+      }
+
+      CloseConnection(conn);
+      continue;
+    }
+
+    // The socket is disconected if receive EPOLLERR or EPOLLRDHUP.
+    if (event.events & (EPOLLIN | EPOLLERR | EPOLLRDHUP)) {
+      if (conn->type() == Connection::kTypeAcceptor) {
+        HandleAccpet(conn);
+      } else if (conn->type() == Connection::kTypeSocket) {
+        HandleRead(conn);
+      } else if (conn->type() == Connection::kTypeWakener) {
+        conn->HandleWakeUp();
+      }
+
+      // The connection may be closed when reading.
+      if (conn->fd() == -1) {
+        continue;
+      }
+    }
+
+    if (event.events & EPOLLOUT) {
+      HandleWrite(conn);
+    }
+  }
+
+  HandleUnfinishedReads(unfinished_reads);
+
+  // Clear the flag before handling, so the responses and timers added later will wake up
+  // the loop again.
+  wakeup_pending_.store(false);
+  bool has_responses = !pending_responses_.Empty();
+  HandlePendingResponses();
+  HandlePendingTimers();
+
+  HandleTimeouts();
+
+  if (CONFIG.spin_poll_us > 0) {
+    bool active = n > 0 || has_responses || !unfinished_reads.empty();
+    if (spinning) {
+      (active ? spin_hits_ : wasted_spins_).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (active) {
+      spin_deadline_us_ = GetSteadyMicroseconds() + CONFIG.spin_poll_us;
+    }
+  }
+
+  return true;
+}
+
+bool EventLoop::UpdateSpinning() {
+  if (GetSteadyMicroseconds() < spin_deadline_us_) {
+    spinning_.store(true, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Pair with the fence in AddResponse(). Either the loop finds the response before blocking, or
+  // the worker finds the loop not spinning and writes the eventfd.
+  spinning_.store(false, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return false;
+}
+
+void EventLoop::AddResponse(MessagePtr response) {
+  pending_responses_.Push(std::move(response));
+
+  // The spinning loop finds the response without waking up.
+  if (CONFIG.spin_poll_us > 0) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (spinning_.load(std::memory_order_relaxed)) {
+      return;
+    }
+  }
+
+  // Wake up epoll_wait to handle pending responses.
+  WakeUp();
+}
+
+void EventLoop::SendResponse(MessagePtr response) {
+  local_responses_.push_back(std::move(response));
+}
+
+void EventLoop::AddTimer(TimerPtr timer) {
+  {
+    std::lock_guard<std::mutex> lock(pending_timer_mutex_);
+    pending_timers_.push_back(timer);
+  }
+
+  // Wake up epoll_wait to handle pending timers.
+  WakeUp();
+}
+
+// In I/O thread.
+// Accept until EAGAIN or accept_batch_size connections are accepted. The acceptor is level
+// triggered, so the left connections will be accepted in the next loop.
+void EventLoop::HandleAccpet(Connection* conn) {
+  if (conn == nullptr) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < CONFIG.accept_batch_size; ++i) {
+    struct sockaddr_in sock_addr;
+    int fd = conn->HandleAccept(&sock_addr);
+    if (fd == -1) {
+      return;
+    }
+
+    AddConnection(fd, sock_addr);
+  }
+}
+
+// In I/O thread.
+void EventLoop::AddConnection(int fd, const struct sockaddr_in& sock_addr) {
+  Connection* new_conn = connection_pool_->Get();
+  if (new_conn == nullptr) {
+    SPDLOG_WARN("Connection pool is empty. Remote addr: {}:{}.",
+                sock::IpToString(sock_addr.sin_addr.s_addr), ntohs(sock_addr.sin_port));
+    close(fd);
+    return;
+  }
+
+  SetAcceptedSocketOptions(fd);
+
+  new_conn->set_fd(fd);
+  new_conn->set_remote_addr(sock_addr.sin_addr.s_addr);
+  new_conn->set_remote_port(ntohs(sock_addr.sin_port));
+  // The completions are reported once, so the received data is drained like edge triggered.
+  new_conn->set_edge_triggered(CONFIG.edge_triggered || poller_->CompletionBased());
+  new_conn->set_ordered(CONFIG.ordered_responses);
+  new_conn->set_last_active_ms(now_ms_);
+  new_conn->SetReadEvent(true);
+
+  if (!poller_->AddSocket(new_conn->fd(), new_conn->epoll_events(),
+      static_cast<void*>(new_conn))) {
+    SPDLOG_ERROR("Failed to update epoll event. Remote addr: {}:{}.", new_conn->remote_ip(),
+                 new_conn->remote_port());
+    connection_pool_->Release(new_conn);
+    return;
+  }
+
+  ScheduleTimeout(new_conn);
+
+  if (on_connected_) {
+    on_connected_(new_conn);
+  }
+}
+
+// In I/O thread.
+void EventLoop::CloseConnection(Connection* conn) {
+  timeout_wheel_.Cancel(conn->timeout_node());
+  poller_->Remove(conn->fd());
+  connection_pool_->Release(conn);
+}
+
+// In I/O thread.
+// The complete messages in the read buffer are parsed before reading the socket again.
+// Level triggered: Read once. The epoll will notify again if some data left.
+// Edge triggered: Read until EAGAIN.
+// At most read_budget messages are handled at a time to be fair to other connections. The left
+// data will be handled in the next loop.
+void EventLoop::HandleRead(Connection* conn) {
+  size_t read_count = 0;
+  bool received = false;
+  for (;;) {
+    // The client sends requests faster than it receives responses.
+    if (ShouldPauseReading(conn)) {
+      PauseReading(conn);
+      return;
+    }
+
+    MessagePtr request;
+    if (!conn->ParseMessage(&request)) {
+      SPDLOG_WARN("Invalid message. Remote addr: {}:{}.", conn->remote_ip(), conn->remote_port());
+      if (on_disconnected_) {
+        on_disconnected_(conn);
+      }
+
+      CloseConnection(conn);
+      return;
+    }
+
+    if (request) {
+      conn->set_partial_since_ms(0);
+
+      conn->AddInflightRequest(request.get());
+      request_handler_(std::move(request));
+
+      if (++read_count >= CONFIG.read_budget) {
+        break;
+      }
+
+      continue;
+    }
+
+    if (received && !conn->edge_triggered()) {
+      UpdatePartialMessage(conn);
+      return;
+    }
+
+    bool would_block = false;
+    if (!conn->HandleRead(&would_block)) {
+      if (on_disconnected_) {
+        on_disconnected_(conn);
+      }
+
+      CloseConnection(conn);
+      return;
+    }
+
+    if (would_block) {
+      UpdatePartialMessage(conn);
+      return;
+    }
+
+    // Re-arm the quick ack once per read event instead of after every recv of the edge
+    // triggered draining. It costs a setsockopt call.
+    if (!received && CONFIG.tcp_quick_ack) {
+      SetQuickAck(conn->fd());
+    }
+
+    received = true;
+    conn->set_last_active_ms(now_ms_);
+  }
+
+  unfinished_reads_.push_back(conn->handle());
+}
+
+// In I/O thread.
+void EventLoop::HandleWrite(Connection* conn) {
+  if (!conn->HandleWrite()) {
+    if (on_disconnected_) {
+      on_disconnected_(conn);
+    }
+
+    CloseConnection(conn);
+    return;
+  }
+
+  conn->set_last_active_ms(now_ms_);
+  UpdateReading(conn);
+
+  // The EPOLLOUT event will be triggered constantly if the socket is writable.
+  // So if the data is sened completely, the EPOLLOUT event should be removed from epoll.
+  // The completion of a send in flight is reported without waiting writable.
+  bool waiting_writable = (conn->epoll_events() & EPOLLOUT) != 0;
+  if (conn->WaitingWritable() != waiting_writable) {
+    conn->SetWriteEvent(!waiting_writable);
+    poller_->Modify(conn->fd(), conn->epoll_events(), static_cast<void*>(conn));
+  }
+}
+
+// In I/O thread.
+void EventLoop::UpdatePartialMessage(Connection* conn) {
+  if (!conn->HasPartialMessage()) {
+    conn->set_partial_since_ms(0);
+    return;
+  }
+
+  // The partial frame timeout is earlier than the scheduled idle timeout usually.
+  if (conn->partial_since_ms() == 0) {
+    conn->set_partial_since_ms(now_ms_);
+    ScheduleTimeout(conn);
+  }
+}
+
+// In I/O thread.
+int64_t EventLoop::GetTimeoutDeadline(const Connection* conn) const {
+  int64_t deadline = 0;
+  if (CONFIG.idle_timeout_ms > 0) {
+    deadline = conn->last_active_ms() + CONFIG.idle_timeout_ms;
+  }
+
+  if (CONFIG.partial_frame_timeout_ms > 0 && conn->partial_since_ms() != 0) {
+    int64_t partial_deadline = conn->partial_since_ms() + CONFIG.partial_frame_timeout_ms;
+    if (deadline == 0 || partial_deadline < deadline) {
+      deadline = partial_deadline;
+    }
+  }
+
+  return deadline;
+}
+
+// In I/O thread.
+// The timeout is not rescheduled when the connection is active. The deadline is checked again
+// when the timeout expires, so receiving data only updates the last active time.
+void EventLoop::ScheduleTimeout(Connection* conn) {
+  int64_t deadline = GetTimeoutDeadline(conn);
+  if (deadline == 0) {
+    timeout_wheel_.Cancel(conn->timeout_node());
+    return;
+  }
+
+  timeout_wheel_.Schedule(conn->timeout_node(), deadline);
+}
+
+// In I/O thread.
+void EventLoop::HandleTimeouts() {
+  if (timeout_wheel_.size() == 0) {
+    return;
+  }
+
+  std::vector<TimeoutNode*> expired;
+  timeout_wheel_.Advance(now_ms_, &expired);
+
+  for (TimeoutNode* node : expired) {
+    Connection* conn = static_cast<Connection*>(node->data);
+    if (conn->fd() == -1) {
+      continue;
+    }
+
+    // The server stops reading the connection to wait for the responses, so the client is
+    // not idle.
+    if (!conn->reading() && !conn->HasSendData()) {
+      conn->set_last_active_ms(now_ms_);
+      conn->set_partial_since_ms(0);
+    }
+
+    int64_t deadline = GetTimeoutDeadline(conn);
+    if (deadline == 0 || deadline > now_ms_) {
+      ScheduleTimeout(conn);
+      continue;
+    }
+
+    SPDLOG_INFO("Connection timeout. Remote addr: {}:{}.", conn->remote_ip(), conn->remote_port());
+    if (on_disconnected_) {
+      on_disconnected_(conn);
+    }
+
+    CloseConnection(conn);
+  }
+}
+
+// In I/O thread.
+void EventLoop::PauseReading(Connection* conn) {
+  if (!conn->reading()) {
+    return;
+  }
+
+  conn->SetReadEvent(false);
+  poller_->Modify(conn->fd(), conn->epoll_events(), static_cast<void*>(conn));
+}
+
+// In I/O thread.
+void EventLoop::ResumeReading(Connection* conn) {
+  if (conn->reading()) {
+    return;
+  }
+
+  conn->SetReadEvent(true);
+  poller_->Modify(conn->fd(), conn->epoll_events(), static_cast<void*>(conn));
+
+  // The edge triggered socket may not be notified again. And the messages may be left in
+  // the read buffer.
+  unfinished_reads_.push_back(conn->handle());
+}
+
+bool EventLoop::ShouldPauseReading(const Connection* conn) const {
+  // Too many requests are waiting for responses in the reorder window.
+  if (conn->ordered() && conn->InflightRequests() >= CONFIG.reorder_window_size) {
+    return true;
+  }
+
+  if (CONFIG.inflight_high_watermark > 0 &&
+      conn->InflightRequests() >= CONFIG.inflight_high_watermark) {
+    return true;
+  }
+
+  if (CONFIG.send_high_watermark > 0 && conn->send_bytes() >= CONFIG.send_high_watermark) {
+    return true;
+  }
+
+  return false;
+}
+
+bool EventLoop::CanResumeReading(const Connection* conn) const {
+  if (conn->ordered() && conn->InflightRequests() >= CONFIG.reorder_window_size) {
+    return false;
+  }
+
+  if (CONFIG.inflight_high_watermark > 0 &&
+      conn->InflightRequests() > CONFIG.inflight_low_watermark) {
+    return false;
+  }
+
+  if (CONFIG.send_high_watermark > 0 && conn->send_bytes() > CONFIG.send_low_watermark) {
+    return false;
+  }
+
+  return true;
+}
+
+// In I/O thread.
+void EventLoop::UpdateReading(Connection* conn) {
+  if (conn->reading()) {
+    if (ShouldPauseReading(conn)) {
+      PauseReading(conn);
+    }
+  } else if (CanResumeReading(conn)) {
+    ResumeReading(conn);
+  }
+}
+
+// In I/O thread.
+void EventLoop::HandleUnfinishedReads(const std::vector<ConnectionHandle>& reads) {
+  ConnectionTable* connection_table = ConnectionTable::GetInstance();
+  for (ConnectionHandle read : reads) {
+    Connection* conn = connection_table->Find(read);
+    if (conn == nullptr) {
+      continue;
+    }
+
+    HandleRead(conn);
+  }
+}
+
+// In I/O thread.
+void EventLoop::HandlePendingResponses() {
+  // Append all the responses to the outbound queues first, so the responses of the same
+  // connection are sended by one gather write.
+  std::vector<Connection*> conns;
+  for (MessagePtr& response : local_responses_) {
+    AppendResponse(std::move(response), &conns);
+  }
+  local_responses_.clear();
+
+  for (MessagePtr response = pending_responses_.Pop(); response; response = pending_responses_.Pop()) {
+    AppendResponse(std::move(response), &conns);
+  }
+
+  for (Connection* conn : conns) {
+    // The connection may be closed by the previous write error.
+    if (conn->fd() == -1) {
+      continue;
+    }
+
+    HandleWrite(conn);
+  }
+}
+
+// In I/O thread.
+void EventLoop::AppendResponse(MessagePtr response, std::vector<Connection*>* conns) {
+  Connection* conn = response->conn();
+  if (conn == nullptr) {
+    SPDLOG_DEBUG("Expired reponse.");
+    return;
+  }
+
+  // If the outbound queue is not empty, the connection is already waiting the writable event
+  // or added into conns.
+  bool has_send_data = conn->HasSendData();
+  conn->AppendResponse(std::move(response));
+  if (!has_send_data && conn->HasSendData()) {
+    conns->push_back(conn);
+  }
+
+  UpdateReading(conn);
+}
+
+// In I/O thread.
+void EventLoop::HandlePendingTimers() {
+  std::vector<TimerPtr> timers;
+  {
+    std::lock_guard<std::mutex> lock(pending_timer_mutex_);
+    timers.swap(pending_timers_);
+  }
+
+  for (TimerPtr timer : timers) {
+    timer->Run();
+  }
+}
+
+void EventLoop::WakeUp() {
+  // The loop has been woken up and doesn't handle the pending responses and timers yet.
+  if (wakeup_pending_.exchange(true)) {
+    return;
+  }
+
+  uint64_t one = 1;
+  ssize_t n = write(wakener_fd_, &one, sizeof(one));
+  if (n != sizeof(one)) {
+    SPDLOG_ERROR("Failed to wakeup.");
+  }
+}
+
+}  // namespace epoll_server
@@ -0,0 +1,191 @@
+#ifndef EPOLL_SERVER_EVENT_LOOP_H_
+#define EPOLL_SERVER_EVENT_LOOP_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "epoll_server/connection.h"
+#include "epoll_server/connection_pool.h"
+#include "epoll_server/message.h"
+#include "epoll_server/mpsc_queue.h"
+#include "epoll_server/noncopyable.h"
+#include "epoll_server/poller.h"
+#include "epoll_server/timeout_wheel.h"
+#include "epoll_server/timer.h"
+
+namespace epoll_server {
+
+// An EventLoop is a reactor running in one I/O thread. It owns the epoll instance, the
+// acceptor, the wakener eventfd, the connection pool and the pending responses of the thread.
+// All the accept, read and write operations of its connections are in the same thread.
+
+class EventLoop : private Noncopyable {
+public:
+  using RequestHandler = std::function<void(MessagePtr)>;
+  using ConnectionCallback = std::function<void(Connection*)>;
+
+  EventLoop();
+
+  ~EventLoop() = default;
+
+  // The acceptor fd should be a non-blocking listening socket. It's closed with the loop.
+  bool Init(int acceptor_fd, size_t connection_pool_size);
+
+  // Poll events until Quit() is called or some errors occurred.
+  void Loop();
+
+  // Thread safe. Stop the loop after the current polling.
+  void Quit();
+
+  bool PollOnce();
+
+  // Thread safe. Send the response in the I/O thread.
+  void AddResponse(MessagePtr response);
+
+  // In I/O thread. Send the response at the end of the loop without waking up. The responses
+  // of the same connection are sended by one gather write too.
+  void SendResponse(MessagePtr response);
+
+  // Thread safe. Run the timer in the I/O thread.
+  void AddTimer(TimerPtr timer);
+
+  // In I/O thread. The completion based poller accepts, receives and sends for the connections.
+  Poller* poller() const {
+    return poller_.get();
+  }
+
+  void set_request_handler(const RequestHandler& request_handler) {
+    request_handler_ = request_handler;
+  }
+
+  void set_on_connected(const ConnectionCallback& on_connected) {
+    on_connected_ = on_connected;
+  }
+
+  void set_on_disconnected(const ConnectionCallback& on_disconnected) {
+    on_disconnected_ = on_disconnected;
+  }
+
+  // The count of non-blocking polls which found some events or responses while spinning.
+  uint64_t spin_hits() const {
+    return spin_hits_.load(std::memory_order_relaxed);
+  }
+
+  // The count of non-blocking polls which found nothing while spinning.
+  uint64_t wasted_spins() const {
+    return wasted_spins_.load(std::memory_order_relaxed);
+  }
+
+private:
+  void HandleAccpet(Connection* conn);
+  void HandleRead(Connection* conn);
+
+  // Send the outbound queue of the connection and wait the writable event if some data left.
+  void HandleWrite(Connection* conn);
+
+  // Stop reading the connection by removing the read event. The data left in the read buffer
+  // is handled after resuming.
+  void PauseReading(Connection* conn);
+  void ResumeReading(Connection* conn);
+
+  // The outbound bytes or the in flight requests reach the high watermark.
+  bool ShouldPauseReading(const Connection* conn) const;
+
+  // Both the outbound bytes and the in flight requests drop to the low watermark.
+  bool CanResumeReading(const Connection* conn) const;
+
+  // Pause or resume reading according to the watermarks.
+  void UpdateReading(Connection* conn);
+
+  // Check whether the connection has an uncompleted message in the read buffer after reading.
+  void UpdatePartialMessage(Connection* conn);
+
+  // Return the earlier one of the idle deadline and the partial frame deadline, or 0 if no
+  // timeout is enabled.
+  int64_t GetTimeoutDeadline(const Connection* conn) const;
+
+  // Schedule the earlier one of the idle timeout and the partial frame timeout.
+  void ScheduleTimeout(Connection* conn);
+
+  // Close the connections which are idle or receive a message too slowly.
+  void HandleTimeouts();
+
+  void AddConnection(int fd, const struct sockaddr_in& sock_addr);
+
+  // Unregister the connection from poller and release it to the connection pool.
+  void CloseConnection(Connection* conn);
+
+  // Continue to read the connections which used up the read budget.
+  void HandleUnfinishedReads(const std::vector<ConnectionHandle>& reads);
+
+  void HandlePendingResponses();
+
+  // Append the response to the outbound queue of its connection. The connection is added into
+  // conns if the outbound queue becomes not empty.
+  void AppendResponse(MessagePtr response, std::vector<Connection*>* conns);
+
+  void HandlePendingTimers();
+
+  // Return true if the spin budget after the last activity is not used up. Otherwise stop
+  // spinning, so the workers wake up the loop by the eventfd again.
+  bool UpdateSpinning();
+
+  // Trigger a epoll event and wake up epoll_wait. Only the first call after the loop handles
+  // the pending responses and timers writes the eventfd.
+  void WakeUp();
+
+private:
+  std::unique_ptr<Connection> acceptor_connection_;
+
+  int wakener_fd_;
+  std::unique_ptr<Connection> wakener_connection_;
+
+  PollerPtr poller_;
+
+  std::unique_ptr<ConnectionPool> connection_pool_;
+
+  // The time after the last polling. It's used as the current time of the connections.
+  int64_t now_ms_;
+
+  TimeoutWheel timeout_wheel_;
+
+  // The connections with data left in socket or read buffer. They are referred by handle, so
+  // the connections closed or reused before reading again are skipped.
+  std::vector<ConnectionHandle> unfinished_reads_;
+
+  // The worker threads push responses without lock.
+  MpscQueue<Message> pending_responses_;
+
+  // The responses of the inline routers.
+  std::vector<MessagePtr> local_responses_;
+
+  // Spin until the deadline, which is extended by every polling with some activity.
+  int64_t spin_deadline_us_;
+
+  // The workers don't wake up the spinning loop, which checks the pending responses in every
+  // polling.
+  std::atomic<bool> spinning_;
+
+  std::atomic<uint64_t> spin_hits_;
+  std::atomic<uint64_t> wasted_spins_;
+
+  // Set by the first WakeUp() after the pending responses and timers are handled.
+  std::atomic<bool> wakeup_pending_;
+
+  std::atomic<bool> quit_;
+
+  std::mutex pending_timer_mutex_;
+  std::vector<TimerPtr> pending_timers_;
+
+  RequestHandler request_handler_;
+
+  ConnectionCallback on_connected_;
+  ConnectionCallback on_disconnected_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_EVENT_LOOP_H_
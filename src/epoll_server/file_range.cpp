@@ -0,0 +1,86 @@
+#include "epoll_server/file_range.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "epoll_server/crc32.h"
+#include "epoll_server/logging.h"
+
+namespace epoll_server {
+
+// Calculate the CRC32 of the range by reading it block by block.
+// Return false if the file is shorter than the range.
+static bool CalcFileCRC32(int fd, uint64_t offset, uint64_t length, uint32_t* crc32) {
+  const size_t kBlockSize = 65536;
+  std::vector<char> block(kBlockSize);
+
+  *crc32 = 0;
+  while (length > 0) {
+    size_t len = static_cast<size_t>(std::min<uint64_t>(length, kBlockSize));
+    ssize_t n = pread(fd, block.data(), len, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (n <= 0) {
+      return false;
+    }
+
+    *crc32 = ExtendCRC32(*crc32, block.data(), static_cast<size_t>(n));
+    offset += static_cast<uint64_t>(n);
+    length -= static_cast<uint64_t>(n);
+  }
+
+  return true;
+}
+
+FileRangePtr FileRange::Open(const std::string& path) {
+  return Open(path, 0, UINT64_MAX);
+}
+
+FileRangePtr FileRange::Open(const std::string& path, uint64_t offset, uint64_t length) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    SPDLOG_WARN("Failed to open file: {}. Error: {}.", path, strerror(errno));
+    return FileRangePtr();
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < offset) {
+    SPDLOG_WARN("Invalid file range: {}, offset: {}.", path, offset);
+    close(fd);
+    return FileRangePtr();
+  }
+
+  length = std::min(length, static_cast<uint64_t>(st.st_size) - offset);
+  if (length > UINT32_MAX) {
+    SPDLOG_WARN("File range is too long: {}, length: {}.", path, length);
+    close(fd);
+    return FileRangePtr();
+  }
+
+  uint32_t crc32 = 0;
+  if (!CalcFileCRC32(fd, offset, length, &crc32)) {
+    SPDLOG_WARN("Failed to read file: {}.", path);
+    close(fd);
+    return FileRangePtr();
+  }
+
+  return FileRangePtr(new FileRange(fd, offset, static_cast<uint32_t>(length), crc32));
+}
+
+FileRange::FileRange(int fd, uint64_t offset, uint32_t length, uint32_t crc32)
+    : fd_(fd), offset_(offset), length_(length), crc32_(crc32) {
+}
+
+FileRange::~FileRange() {
+  close(fd_);
+}
+
+}  // namespace epoll_server
@@ -0,0 +1,58 @@
+#ifndef EPOLL_SERVER_FILE_RANGE_H_
+#define EPOLL_SERVER_FILE_RANGE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "epoll_server/noncopyable.h"
+
+namespace epoll_server {
+
+class FileRange;
+
+using FileRangePtr = std::shared_ptr<const FileRange>;
+
+// A range of a file sended as the response data by sendfile, from the page cache to the socket
+// without copying to user space. The CRC32 is calculated once when the range is opened, so the
+// file should not be modified while it's served. A range can be cached and shared by many
+// responses. The file is closed after the last reference is released.
+
+class FileRange : private Noncopyable {
+public:
+  // Open the whole file, or length bytes from offset.
+  // Return nullptr if the file can't be read or is longer than UINT32_MAX.
+  static FileRangePtr Open(const std::string& path);
+  static FileRangePtr Open(const std::string& path, uint64_t offset, uint64_t length);
+
+  ~FileRange();
+
+  int fd() const {
+    return fd_;
+  }
+
+  uint64_t offset() const {
+    return offset_;
+  }
+
+  uint32_t length() const {
+    return length_;
+  }
+
+  uint32_t crc32() const {
+    return crc32_;
+  }
+
+private:
+  FileRange(int fd, uint64_t offset, uint32_t length, uint32_t crc32);
+
+private:
+  int fd_;
+  uint64_t offset_;
+  uint32_t length_;
+  uint32_t crc32_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_FILE_RANGE_H_
@@ -0,0 +1,102 @@
+#ifndef EPOLL_SERVER_INTRUSIVE_PTR_H_
+#define EPOLL_SERVER_INTRUSIVE_PTR_H_
+
+#include <cstddef>
+#include <utility>
+
+namespace epoll_server {
+
+// A smart pointer to the object with an intrusive reference count. T should have Ref() and
+// Unref(), and Unref() releases the object when the count drops to 0.
+// Unlike std::shared_ptr, there is no separated control block. Moving the pointer doesn't touch
+// the reference count, so it should be moved rather than copied along the pipeline.
+
+template <class T>
+class IntrusivePtr {
+public:
+  IntrusivePtr() : ptr_(nullptr) {
+  }
+
+  IntrusivePtr(std::nullptr_t) : ptr_(nullptr) {
+  }
+
+  // Add a reference if add_ref, otherwise adopt the reference owned by the caller.
+  explicit IntrusivePtr(T* ptr, bool add_ref = true) : ptr_(ptr) {
+    if (ptr_ != nullptr && add_ref) {
+      ptr_->Ref();
+    }
+  }
+
+  IntrusivePtr(const IntrusivePtr& other) : ptr_(other.ptr_) {
+    if (ptr_ != nullptr) {
+      ptr_->Ref();
+    }
+  }
+
+  IntrusivePtr(IntrusivePtr&& other) : ptr_(other.ptr_) {
+    other.ptr_ = nullptr;
+  }
+
+  ~IntrusivePtr() {
+    if (ptr_ != nullptr) {
+      ptr_->Unref();
+    }
+  }
+
+  IntrusivePtr& operator=(IntrusivePtr other) {
+    std::swap(ptr_, other.ptr_);
+    return *this;
+  }
+
+  T* get() const {
+    return ptr_;
+  }
+
+  T* operator->() const {
+    return ptr_;
+  }
+
+  T& operator*() const {
+    return *ptr_;
+  }
+
+  explicit operator bool() const {
+    return ptr_ != nullptr;
+  }
+
+  void reset() {
+    IntrusivePtr().swap(*this);
+  }
+
+  void reset(T* ptr) {
+    IntrusivePtr(ptr).swap(*this);
+  }
+
+  // Return the pointer without releasing the reference. The caller owns the reference.
+  T* release() {
+    T* ptr = ptr_;
+    ptr_ = nullptr;
+    return ptr;
+  }
+
+  void swap(IntrusivePtr& other) {
+    std::swap(ptr_, other.ptr_);
+  }
+
+private:
+  T* ptr_;
+};
+
+template <class T>
+bool operator==(const IntrusivePtr<T>& ptr, std::nullptr_t) {
+  return !ptr;
+}
+
+template <class T>
+bool operator!=(const IntrusivePtr<T>& ptr, std::nullptr_t) {
+  return static_cast<bool>(ptr);
+}
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_INTRUSIVE_PTR_H_
@@ -0,0 +1,1069 @@
+#include "epoll_server/io_uring_poller.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+
+// The headers older than Linux 6.0 don't have the multishot receive.
+#ifndef IORING_RECV_MULTISHOT
+#undef HAVE_LINUX_IO_URING_H
+#endif
+#endif
+
+#include "epoll_server/logging.h"
+
+namespace epoll_server {
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+static const unsigned kSqEntries = 1024;
+static const unsigned kCqEntries = 4 * kSqEntries;
+
+// The buffers of the multishot receives. The count should be a power of 2.
+static const unsigned kRecvBufferCount = 256;
+static const size_t kRecvBufferSize = 16384;
+static const uint16_t kRecvBufferGroup = 0;
+
+// User data = Op(8 bits) << 56 | Generation(24 bits) << 32 | Id(32 bits).
+// The id is the fd, or the index of the send.
+enum Op {
+  kOpPoll = 0,
+  kOpAccept,
+  kOpRecv,
+  kOpSend,
+
+  // The completions of the poll remove and cancel requests are ignored.
+  kOpCancel = 0xFF
+};
+
+static inline uint64_t EncodeUserData(Op op, uint32_t generation, uint32_t id) {
+  return static_cast<uint64_t>(op) << 56 | static_cast<uint64_t>(generation & 0xFFFFFF) << 32 |
+         id;
+}
+
+static inline Op GetOp(uint64_t user_data) {
+  return static_cast<Op>(user_data >> 56);
+}
+
+static inline uint32_t GetId(uint64_t user_data) {
+  return static_cast<uint32_t>(user_data);
+}
+
+static inline bool SameGeneration(uint32_t generation, uint64_t user_data) {
+  return (generation & 0xFFFFFF) == ((user_data >> 32) & 0xFFFFFF);
+}
+
+IoUringPoller::IoUringPoller()
+    : fd_(-1)
+    , sq_ring_(nullptr)
+    , sq_ring_size_(0)
+    , cq_ring_(nullptr)
+    , cq_ring_size_(0)
+    , sqes_(nullptr)
+    , sqes_size_(0)
+    , sq_head_(nullptr)
+    , sq_tail_(nullptr)
+    , sq_mask_(0)
+    , sq_entries_(0)
+    , cq_head_(nullptr)
+    , cq_tail_(nullptr)
+    , cq_mask_(0)
+    , cqes_(nullptr)
+    , sq_local_tail_(0)
+    , to_submit_(0)
+    , completion_based_(false)
+    , buf_ring_(nullptr)
+    , buf_ring_size_(0)
+    , recv_buffers_(nullptr)
+    , recv_buffers_size_(0)
+    , buf_ring_tail_(0)
+    , event_round_(0)
+    , event_count_(0) {
+  memset(events_, 0, sizeof(events_));
+}
+
+IoUringPoller::~IoUringPoller() {
+  for (AcceptQueue& queue : accept_queues_) {
+    for (int fd : queue.fds) {
+      close(fd);
+    }
+  }
+
+  // The requests in flight are cancelled when the io_uring fd is closed.
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+  }
+
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+
+  if (recv_buffers_ != nullptr) {
+    munmap(recv_buffers_, recv_buffers_size_);
+  }
+
+  if (buf_ring_ != nullptr) {
+    munmap(buf_ring_, buf_ring_size_);
+  }
+}
+
+bool IoUringPoller::Create() {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = kCqEntries;
+
+  // The io_uring fd is close-on-exec.
+  fd_ = static_cast<int>(syscall(__NR_io_uring_setup, kSqEntries, &params));
+  if (fd_ == -1) {
+    SPDLOG_ERROR("Failed to setup io_uring. Error: {}-{}.", errno, strerror(errno));
+    return false;
+  }
+
+  // Waiting with timeout needs IORING_ENTER_EXT_ARG. Linux 5.11+.
+  if ((params.features & IORING_FEAT_EXT_ARG) == 0) {
+    SPDLOG_ERROR("io_uring doesn't support IORING_FEAT_EXT_ARG.");
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // The submission and completion rings can be mapped in one mmap since Linux 5.4.
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    cq_ring_size_ = sq_ring_size_;
+  }
+
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    SPDLOG_ERROR("Failed to mmap io_uring submission ring.");
+    return false;
+  }
+
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      SPDLOG_ERROR("Failed to mmap io_uring completion ring.");
+      return false;
+    }
+  }
+
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to mmap io_uring submission entries.");
+    return false;
+  }
+  sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+  char* sq_ring = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+  sq_entries_ = *reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_entries);
+  sq_local_tail_ = *sq_tail_;
+
+  // The submission entries are always used in order, so the index array is fixed.
+  unsigned* sq_array = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+  for (unsigned i = 0; i < sq_entries_; ++i) {
+    sq_array[i] = i;
+  }
+
+  char* cq_ring = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+
+  completion_based_ = SetupBufferRing() && ProbeMultishotRecv();
+  if (!completion_based_) {
+    SPDLOG_WARN("io_uring doesn't support multishot receive. Poll the sockets instead.");
+  }
+
+  return true;
+}
+
+int IoUringPoller::Poll(int waiting_ms) {
+  ++event_round_;
+  event_count_ = 0;
+
+  std::vector<int> rearm_fds;
+  rearm_fds.swap(rearm_fds_);
+  for (int fd : rearm_fds) {
+    Registration* reg = Find(fd);
+    if (reg != nullptr) {
+      Arm(fd, reg);
+    }
+  }
+
+  // The accepted sockets not taken are reported again like a level triggered listening fd.
+  bool accepted = false;
+  for (const AcceptQueue& queue : accept_queues_) {
+    accepted = accepted || !queue.fds.empty();
+  }
+
+  // Enter even if not waiting, so the completions in the task work of the thread are posted.
+  // Don't wait if some completions have not been reaped.
+  unsigned cq_ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+  if (cq_ready == 0 || to_submit_ > 0) {
+    bool waiting = cq_ready == 0 && waiting_ms != 0 && !accepted;
+    if (Enter(waiting ? 1 : 0, waiting ? waiting_ms : 0) == -1) {
+      return -1;
+    }
+  }
+
+  ReapCompletions();
+
+  for (const AcceptQueue& queue : accept_queues_) {
+    Registration* reg = Find(queue.listen_fd);
+    if (reg != nullptr && !queue.fds.empty()) {
+      ReportEvents(reg, EPOLLIN);
+    }
+  }
+
+  return event_count_;
+}
+
+const struct epoll_event& IoUringPoller::GetEvent(size_t index) const {
+  assert(index < kMaxEpollEvents);
+  return events_[index];
+}
+
+bool IoUringPoller::Add(int target_fd, uint32_t events, void* ptr) {
+  return Register(target_fd, kKindPoll, events, ptr) != nullptr;
+}
+
+bool IoUringPoller::AddAcceptor(int listen_fd, void* ptr) {
+  if (!completion_based_) {
+    return Add(listen_fd, EPOLLIN, ptr);
+  }
+
+  if (Register(listen_fd, kKindAcceptor, EPOLLIN, ptr) == nullptr) {
+    return false;
+  }
+
+  AcceptQueue queue;
+  queue.listen_fd = listen_fd;
+  accept_queues_.push_back(queue);
+  return true;
+}
+
+bool IoUringPoller::AddSocket(int target_fd, uint32_t events, void* ptr) {
+  return Register(target_fd, completion_based_ ? kKindSocket : kKindPoll, events, ptr) != nullptr;
+}
+
+IoUringPoller::Registration* IoUringPoller::Find(int fd) {
+  if (fd < 0 || static_cast<size_t>(fd) >= registrations_.size() ||
+      !registrations_[fd].registered) {
+    return nullptr;
+  }
+
+  return &registrations_[fd];
+}
+
+IoUringPoller::Registration* IoUringPoller::Register(int fd, Kind kind, uint32_t events,
+                                                     void* ptr) {
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  if (static_cast<size_t>(fd) >= registrations_.size()) {
+    Registration reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.recv_head = -1;
+    reg.recv_tail = -1;
+    reg.send_op = -1;
+    registrations_.resize(fd + 1, reg);
+  }
+
+  Registration& reg = registrations_[fd];
+  if (reg.registered) {
+    SPDLOG_ERROR("Failed to add poll request. The fd {} is registered.", fd);
+    return nullptr;
+  }
+
+  reg.ptr = ptr;
+  reg.events = events;
+  reg.kind = kind;
+  reg.registered = true;
+  ++reg.generation;
+  ++reg.poll_generation;
+
+  // The requests will be submitted in batch at the next Poll().
+  rearm_fds_.push_back(fd);
+  return &reg;
+}
+
+bool IoUringPoller::Modify(int target_fd, uint32_t events, void* ptr) {
+  Registration* reg = Find(target_fd);
+  if (reg == nullptr) {
+    SPDLOG_ERROR("Failed to modify poll request. The fd {} is not registered.", target_fd);
+    return false;
+  }
+
+  // The receive is cancelled to pause reading. The data received before the cancellation is
+  // kept until it's taken.
+  if (reg->kind == kKindSocket && (events & EPOLLIN) == 0 && reg->multishot_armed &&
+      !reg->cancelling) {
+    if (!PrepCancel(EncodeUserData(kOpRecv, reg->generation, target_fd))) {
+      return false;
+    }
+
+    reg->cancelling = true;
+  }
+
+  // A socket is polled only for EPOLLOUT.
+  uint32_t poll_mask = reg->kind == kKindSocket ? EPOLLOUT : ~0U;
+  if ((reg->events & poll_mask) != (events & poll_mask) || reg->kind == kKindPoll) {
+    if (reg->armed && !PrepPollRemove(target_fd, *reg)) {
+      return false;
+    }
+
+    reg->armed = false;
+    ++reg->poll_generation;
+  }
+
+  reg->ptr = ptr;
+  reg->events = events;
+
+  rearm_fds_.push_back(target_fd);
+  return true;
+}
+
+bool IoUringPoller::Remove(int target_fd) {
+  Registration* reg = Find(target_fd);
+  if (reg == nullptr) {
+    return false;
+  }
+
+  // The requests in flight hold the file. The socket will not be closed until they are
+  // cancelled.
+  bool ok = true;
+  if (reg->armed) {
+    ok = PrepPollRemove(target_fd, *reg) && ok;
+  }
+
+  if (reg->multishot_armed) {
+    Op op = reg->kind == kKindAcceptor ? kOpAccept : kOpRecv;
+    ok = PrepCancel(EncodeUserData(op, reg->generation, target_fd)) && ok;
+  }
+
+  // The buffers of the send are released with the connection before it's completed. Shut
+  // down the socket, so the send fails before reading them whenever it's retried.
+  if (reg->send_op != -1) {
+    shutdown(target_fd, SHUT_RDWR);
+    ok = PrepCancel(EncodeUserData(kOpSend, reg->generation, reg->send_op)) && ok;
+  }
+
+  ReleaseReceived(reg);
+
+  if (reg->kind == kKindAcceptor) {
+    for (auto it = accept_queues_.begin(); it != accept_queues_.end(); ++it) {
+      if (it->listen_fd == target_fd) {
+        for (int fd : it->fds) {
+          close(fd);
+        }
+
+        accept_queues_.erase(it);
+        break;
+      }
+    }
+  }
+
+  reg->registered = false;
+  reg->armed = false;
+  reg->multishot_armed = false;
+  reg->cancelling = false;
+  reg->eof = false;
+  reg->error = 0;
+  reg->send_op = -1;
+  reg->send_completed = false;
+  reg->send_result = 0;
+  ++reg->generation;
+  ++reg->poll_generation;
+  return ok;
+}
+
+int IoUringPoller::TakeAccepted(int listen_fd) {
+  AcceptQueue* queue = FindAcceptQueue(listen_fd);
+  if (queue == nullptr || queue->fds.empty()) {
+    return -1;
+  }
+
+  int fd = queue->fds.front();
+  queue->fds.pop_front();
+  return fd;
+}
+
+int IoUringPoller::TakeReceived(int target_fd, char* buf, size_t len) {
+  Registration* reg = Find(target_fd);
+  if (reg == nullptr) {
+    return -1;
+  }
+
+  size_t copied = 0;
+  while (copied < len && reg->recv_head != -1) {
+    uint16_t bid = static_cast<uint16_t>(reg->recv_head);
+    size_t n = std::min<size_t>(buffer_len_[bid] - reg->recv_offset, len - copied);
+    memcpy(buf + copied, RecvBuffer(bid) + reg->recv_offset, n);
+    copied += n;
+    reg->recv_offset += static_cast<uint32_t>(n);
+
+    if (reg->recv_offset == buffer_len_[bid]) {
+      reg->recv_head = buffer_next_[bid];
+      if (reg->recv_head == -1) {
+        reg->recv_tail = -1;
+      }
+
+      reg->recv_offset = 0;
+      RecycleBuffer(bid);
+    }
+  }
+
+  if (copied > 0) {
+    return static_cast<int>(copied);
+  }
+
+  if (reg->error != 0) {
+    SPDLOG_WARN("Failed to recv data. Error: {}-{}.", reg->error, strerror(reg->error));
+    return -1;
+  }
+
+  return reg->eof ? -1 : 0;
+}
+
+bool IoUringPoller::Send(int target_fd, const struct iovec* iov, size_t iov_count, bool more) {
+  Registration* reg = Find(target_fd);
+  if (reg == nullptr || reg->kind != kKindSocket || reg->send_op != -1 || reg->send_completed ||
+      iov_count > kMaxSendIovecs) {
+    SPDLOG_ERROR("Failed to send. The fd {} is not ready to send.", target_fd);
+    return false;
+  }
+
+  struct io_uring_sqe* sqe = GetSqe();
+  if (sqe == nullptr) {
+    SPDLOG_ERROR("io_uring submission queue is full.");
+    return false;
+  }
+
+  int32_t index = 0;
+  if (free_send_ops_.empty()) {
+    index = static_cast<int32_t>(send_ops_.size());
+    send_ops_.emplace_back(new SendOp);
+  } else {
+    index = free_send_ops_.back();
+    free_send_ops_.pop_back();
+  }
+
+  SendOp* op = send_ops_[index].get();
+  op->fd = target_fd;
+  op->generation = reg->generation;
+  memcpy(op->iov, iov, iov_count * sizeof(struct iovec));
+  memset(&op->msg, 0, sizeof(op->msg));
+  op->msg.msg_iov = op->iov;
+  op->msg.msg_iovlen = iov_count;
+
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = target_fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+  sqe->user_data = EncodeUserData(kOpSend, reg->generation, static_cast<uint32_t>(index));
+  CommitSqe();
+
+  reg->send_op = index;
+  return true;
+}
+
+ssize_t IoUringPoller::TakeSent(int target_fd) {
+  Registration* reg = Find(target_fd);
+  if (reg == nullptr) {
+    return -1;
+  }
+
+  if (!reg->send_completed) {
+    return 0;
+  }
+
+  reg->send_completed = false;
+  if (reg->send_result > 0) {
+    return reg->send_result;
+  }
+
+  int err = -reg->send_result;
+  if (err != EPIPE && err != ECONNRESET) {
+    SPDLOG_WARN("Send error: {}:{}.", err, strerror(err));
+  }
+
+  return -1;
+}
+
+struct io_uring_sqe* IoUringPoller::GetSqe() {
+  unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (sq_local_tail_ - head >= sq_entries_) {
+    // The submission queue is full. Submit the queued requests without waiting.
+    if (Enter(0, 0) == -1) {
+      return nullptr;
+    }
+
+    head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_local_tail_ - head >= sq_entries_) {
+      return nullptr;
+    }
+  }
+
+  struct io_uring_sqe* sqe = &sqes_[sq_local_tail_ & sq_mask_];
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+void IoUringPoller::CommitSqe() {
+  ++sq_local_tail_;
+  __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+  ++to_submit_;
+}
+
+void IoUringPoller::Arm(int fd, Registration* reg) {
+  uint32_t poll_events = reg->events & ~(EPOLLET | EPOLLONESHOT);
+  if (reg->kind == kKindSocket) {
+    poll_events &= EPOLLOUT;
+  } else if (reg->kind == kKindAcceptor) {
+    poll_events = 0;
+  }
+
+  if (poll_events != 0 && !reg->armed) {
+    PrepPollAdd(fd, reg);
+  }
+
+  if (reg->kind == kKindAcceptor && !reg->multishot_armed) {
+    PrepAccept(fd, reg);
+  }
+
+  if (reg->kind == kKindSocket && (reg->events & EPOLLIN) && !reg->multishot_armed &&
+      !reg->eof && reg->error == 0) {
+    PrepRecv(fd, reg);
+  }
+}
+
+bool IoUringPoller::PrepPollAdd(int fd, Registration* reg) {
+  struct io_uring_sqe* sqe = GetSqe();
+  if (sqe == nullptr) {
+    SPDLOG_ERROR("io_uring submission queue is full.");
+    rearm_fds_.push_back(fd);
+    return false;
+  }
+
+  uint32_t poll_events = reg->events & ~(EPOLLET | EPOLLONESHOT);
+  if (reg->kind == kKindSocket) {
+    poll_events &= EPOLLOUT;
+  }
+
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  // The poll request is one shot and re-armed after the event is handled.
+  sqe->poll32_events = poll_events;
+  sqe->user_data = EncodeUserData(kOpPoll, reg->poll_generation, fd);
+  CommitSqe();
+
+  reg->armed = true;
+  return true;
+}
+
+bool IoUringPoller::PrepPollRemove(int fd, const Registration& reg) {
+  struct io_uring_sqe* sqe = GetSqe();
+  if (sqe == nullptr) {
+    SPDLOG_ERROR("io_uring submission queue is full.");
+    return false;
+  }
+
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = EncodeUserData(kOpPoll, reg.poll_generation, fd);
+  sqe->user_data = EncodeUserData(kOpCancel, 0, 0);
+  CommitSqe();
+
+  return true;
+}
+
+bool IoUringPoller::PrepAccept(int fd, Registration* reg) {
+  struct io_uring_sqe* sqe = GetSqe();
+  if (sqe == nullptr) {
+    SPDLOG_ERROR("io_uring submission queue is full.");
+    rearm_fds_.push_back(fd);
+    return false;
+  }
+
+  // The address of the multishot accept would be overwritten by the next one, so it's got by
+  // getpeername.
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = EncodeUserData(kOpAccept, reg->generation, fd);
+  CommitSqe();
+
+  reg->multishot_armed = true;
+  return true;
+}
+
+bool IoUringPoller::PrepRecv(int fd, Registration* reg) {
+  struct io_uring_sqe* sqe = GetSqe();
+  if (sqe == nullptr) {
+    SPDLOG_ERROR("io_uring submission queue is full.");
+    rearm_fds_.push_back(fd);
+    return false;
+  }
+
+  // Every completion picks a buffer from the group.
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kRecvBufferGroup;
+  sqe->user_data = EncodeUserData(kOpRecv, reg->generation, fd);
+  CommitSqe();
+
+  reg->multishot_armed = true;
+  return true;
+}
+
+bool IoUringPoller::PrepCancel(uint64_t user_data) {
+  struct io_uring_sqe* sqe = GetSqe();
+  if (sqe == nullptr) {
+    SPDLOG_ERROR("io_uring submission queue is full.");
+    return false;
+  }
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = user_data;
+  sqe->user_data = EncodeUserData(kOpCancel, 0, 0);
+  CommitSqe();
+
+  return true;
+}
+
+int IoUringPoller::Enter(unsigned min_complete, int waiting_ms) {
+  unsigned flags = IORING_ENTER_GETEVENTS;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  memset(&arg, 0, sizeof(arg));
+
+  if (min_complete > 0 && waiting_ms > 0) {
+    flags |= IORING_ENTER_EXT_ARG;
+    ts.tv_sec = waiting_ms / 1000;
+    ts.tv_nsec = (waiting_ms % 1000) * 1000000LL;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+  }
+
+  bool ext_arg = (flags & IORING_ENTER_EXT_ARG) != 0;
+  long n = syscall(__NR_io_uring_enter, fd_, to_submit_, min_complete, flags,
+                   ext_arg ? &arg : nullptr, ext_arg ? sizeof(arg) : 0);
+  // The kernel consumes the submitted entries by moving the head of submission queue.
+  to_submit_ = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+  if (n >= 0) {
+    return 0;
+  }
+
+  // EINTR: Interrupted by signal.
+  // ETIME: Waiting timeout.
+  // EBUSY/EAGAIN: The completion queue is overflowed. The completions should be reaped first.
+  int err = errno;
+  if (err == EINTR || err == ETIME || err == EBUSY || err == EAGAIN) {
+    return 0;
+  }
+
+  SPDLOG_ERROR("Failed to enter io_uring. Error: {}-{}.", err, strerror(err));
+  return -1;
+}
+
+int IoUringPoller::ReapCompletions() {
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+  // Stop before the events array is full. The rest are reaped at the next Poll().
+  while (head != tail && event_count_ < static_cast<int>(kMaxEpollEvents)) {
+    const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+    ++head;
+
+    switch (GetOp(cqe.user_data)) {
+    case kOpPoll:
+      HandlePollCompletion(cqe);
+      break;
+    case kOpAccept:
+      HandleAcceptCompletion(cqe);
+      break;
+    case kOpRecv:
+      HandleRecvCompletion(cqe);
+      break;
+    case kOpSend:
+      HandleSendCompletion(cqe);
+      break;
+    default:
+      break;
+    }
+  }
+
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  return event_count_;
+}
+
+void IoUringPoller::HandlePollCompletion(const struct io_uring_cqe& cqe) {
+  int fd = static_cast<int>(GetId(cqe.user_data));
+
+  // The poll request has been modified or removed.
+  Registration* reg = Find(fd);
+  if (reg == nullptr || !SameGeneration(reg->poll_generation, cqe.user_data)) {
+    return;
+  }
+
+  reg->armed = false;
+  rearm_fds_.push_back(fd);
+
+  if (cqe.res < 0) {
+    SPDLOG_WARN("Failed to poll fd {}. Error: {}-{}.", fd, -cqe.res, strerror(-cqe.res));
+    return;
+  }
+
+  // The poll mask is compatible with the epoll events.
+  ReportEvents(reg, static_cast<uint32_t>(cqe.res));
+}
+
+void IoUringPoller::HandleAcceptCompletion(const struct io_uring_cqe& cqe) {
+  int fd = static_cast<int>(GetId(cqe.user_data));
+
+  // The listening fd has been removed.
+  Registration* reg = Find(fd);
+  if (reg == nullptr || !SameGeneration(reg->generation, cqe.user_data)) {
+    if (cqe.res >= 0) {
+      close(cqe.res);
+    }
+    return;
+  }
+
+  // The multishot accept ends on errors. It's re-armed at the next Poll().
+  if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+    reg->multishot_armed = false;
+    rearm_fds_.push_back(fd);
+  }
+
+  if (cqe.res < 0) {
+    if (cqe.res != -ECANCELED && cqe.res != -EAGAIN && cqe.res != -EINTR) {
+      SPDLOG_WARN("Failed to accept socket. Error: {}-{}.", -cqe.res, strerror(-cqe.res));
+    }
+    return;
+  }
+
+  AcceptQueue* queue = FindAcceptQueue(fd);
+  if (queue == nullptr) {
+    close(cqe.res);
+    return;
+  }
+
+  queue->fds.push_back(cqe.res);
+  ReportEvents(reg, EPOLLIN);
+}
+
+void IoUringPoller::HandleRecvCompletion(const struct io_uring_cqe& cqe) {
+  int fd = static_cast<int>(GetId(cqe.user_data));
+  bool has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+  uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+  // The socket has been removed. The buffer is given back.
+  Registration* reg = Find(fd);
+  if (reg == nullptr || !SameGeneration(reg->generation, cqe.user_data)) {
+    if (has_buffer) {
+      RecycleBuffer(bid);
+    }
+    return;
+  }
+
+  bool ended = (cqe.flags & IORING_CQE_F_MORE) == 0;
+  if (ended) {
+    reg->multishot_armed = false;
+    reg->cancelling = false;
+  }
+
+  if (cqe.res > 0 && has_buffer) {
+    buffer_len_[bid] = static_cast<uint32_t>(cqe.res);
+    buffer_next_[bid] = -1;
+    if (reg->recv_tail == -1) {
+      reg->recv_head = bid;
+    } else {
+      buffer_next_[reg->recv_tail] = bid;
+    }
+    reg->recv_tail = bid;
+
+    ReportEvents(reg, EPOLLIN);
+  } else if (cqe.res == 0) {
+    reg->eof = true;
+    ReportEvents(reg, EPOLLIN | EPOLLRDHUP);
+  } else if (cqe.res == -ENOBUFS) {
+    // Re-armed after some buffers are given back.
+    starved_fds_.push_back(fd);
+    return;
+  } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+    reg->error = -cqe.res;
+    ReportEvents(reg, EPOLLIN | EPOLLERR);
+  }
+
+  // Re-armed at the next Poll() if it's still reading.
+  if (ended) {
+    rearm_fds_.push_back(fd);
+  }
+}
+
+void IoUringPoller::HandleSendCompletion(const struct io_uring_cqe& cqe) {
+  int32_t index = static_cast<int32_t>(GetId(cqe.user_data));
+  if (index < 0 || static_cast<size_t>(index) >= send_ops_.size()) {
+    return;
+  }
+
+  SendOp* op = send_ops_[index].get();
+  free_send_ops_.push_back(index);
+
+  // The socket has been removed.
+  Registration* reg = Find(op->fd);
+  if (reg == nullptr || reg->send_op != index ||
+      !SameGeneration(reg->generation, cqe.user_data)) {
+    return;
+  }
+
+  reg->send_op = -1;
+  reg->send_completed = true;
+  reg->send_result = cqe.res;
+  ReportEvents(reg, EPOLLOUT);
+}
+
+bool IoUringPoller::ReportEvents(Registration* reg, uint32_t events) {
+  if (reg->event_round == event_round_) {
+    events_[reg->event_index].events |= events;
+    return true;
+  }
+
+  if (event_count_ >= static_cast<int>(kMaxEpollEvents)) {
+    return false;
+  }
+
+  reg->event_round = event_round_;
+  reg->event_index = static_cast<uint32_t>(event_count_);
+  events_[event_count_].events = events;
+  events_[event_count_].data.ptr = reg->ptr;
+  ++event_count_;
+  return true;
+}
+
+bool IoUringPoller::SetupBufferRing() {
+  buf_ring_size_ = kRecvBufferCount * sizeof(struct io_uring_buf);
+  void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to mmap io_uring buffer ring.");
+    return false;
+  }
+  buf_ring_ = static_cast<struct io_uring_buf_ring*>(ring);
+
+  // The pages of the buffers are allocated when they are received into.
+  recv_buffers_size_ = kRecvBufferCount * kRecvBufferSize;
+  void* buffers = mmap(nullptr, recv_buffers_size_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffers == MAP_FAILED) {
+    SPDLOG_ERROR("Failed to mmap io_uring receive buffers.");
+    return false;
+  }
+  recv_buffers_ = static_cast<char*>(buffers);
+
+  // Linux 5.19+.
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+  reg.ring_entries = kRecvBufferCount;
+  reg.bgid = kRecvBufferGroup;
+  if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    return false;
+  }
+
+  buffer_next_.assign(kRecvBufferCount, -1);
+  buffer_len_.assign(kRecvBufferCount, 0);
+  for (unsigned i = 0; i < kRecvBufferCount; ++i) {
+    RecycleBuffer(static_cast<uint16_t>(i));
+  }
+
+  return true;
+}
+
+// Receive a byte on a socket pair by a multishot receive. Linux 6.0+.
+bool IoUringPoller::ProbeMultishotRecv() {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0) {
+    return false;
+  }
+
+  Registration reg;
+  memset(&reg, 0, sizeof(reg));
+
+  bool supported = false;
+  bool ended = false;
+  if (PrepRecv(fds[0], &reg) && write(fds[1], "x", 1) == 1) {
+    // Closing the peer ends the receive.
+    for (int i = 0; i < 2 && !ended; ++i) {
+      if (Enter(1, 1000) == -1) {
+        break;
+      }
+
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      for (; head != tail; ++head) {
+        const struct io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+          RecycleBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+
+        if (cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE)) {
+          supported = true;
+        }
+
+        ended = (cqe.flags & IORING_CQE_F_MORE) == 0;
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+      close(fds[1]);
+      fds[1] = -1;
+    }
+  }
+
+  if (fds[1] != -1) {
+    close(fds[1]);
+  }
+  close(fds[0]);
+  return supported && ended;
+}
+
+char* IoUringPoller::RecvBuffer(uint16_t bid) const {
+  return recv_buffers_ + static_cast<size_t>(bid) * kRecvBufferSize;
+}
+
+void IoUringPoller::RecycleBuffer(uint16_t bid) {
+  // The flexible array bufs of the header is after an empty struct, which is 1 byte in C++.
+  struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(buf_ring_);
+  struct io_uring_buf* buf = &bufs[buf_ring_tail_ & (kRecvBufferCount - 1)];
+  buf->addr = reinterpret_cast<uint64_t>(RecvBuffer(bid));
+  buf->len = static_cast<uint32_t>(kRecvBufferSize);
+  buf->bid = bid;
+  ++buf_ring_tail_;
+  __atomic_store_n(&buf_ring_->tail, buf_ring_tail_, __ATOMIC_RELEASE);
+
+  if (!starved_fds_.empty()) {
+    rearm_fds_.insert(rearm_fds_.end(), starved_fds_.begin(), starved_fds_.end());
+    starved_fds_.clear();
+  }
+}
+
+void IoUringPoller::ReleaseReceived(Registration* reg) {
+  while (reg->recv_head != -1) {
+    uint16_t bid = static_cast<uint16_t>(reg->recv_head);
+    reg->recv_head = buffer_next_[bid];
+    RecycleBuffer(bid);
+  }
+
+  reg->recv_tail = -1;
+  reg->recv_offset = 0;
+}
+
+IoUringPoller::AcceptQueue* IoUringPoller::FindAcceptQueue(int listen_fd) {
+  for (AcceptQueue& queue : accept_queues_) {
+    if (queue.listen_fd == listen_fd) {
+      return &queue;
+    }
+  }
+
+  return nullptr;
+}
+
+#else  // HAVE_LINUX_IO_URING_H
+
+IoUringPoller::IoUringPoller() : fd_(-1), completion_based_(false) {
+}
+
+IoUringPoller::~IoUringPoller() {
+}
+
+bool IoUringPoller::Create() {
+  SPDLOG_ERROR("io_uring is not supported.");
+  return false;
+}
+
+int IoUringPoller::Poll(int /*waiting_ms*/) {
+  return -1;
+}
+
+const struct epoll_event& IoUringPoller::GetEvent(size_t index) const {
+  assert(index < kMaxEpollEvents);
+  return events_[index];
+}
+
+bool IoUringPoller::Add(int /*target_fd*/, uint32_t /*events*/, void* /*ptr*/) {
+  return false;
+}
+
+bool IoUringPoller::Modify(int /*target_fd*/, uint32_t /*events*/, void* /*ptr*/) {
+  return false;
+}
+
+bool IoUringPoller::Remove(int /*target_fd*/) {
+  return false;
+}
+
+bool IoUringPoller::AddAcceptor(int /*listen_fd*/, void* /*ptr*/) {
+  return false;
+}
+
+bool IoUringPoller::AddSocket(int /*target_fd*/, uint32_t /*events*/, void* /*ptr*/) {
+  return false;
+}
+
+int IoUringPoller::TakeAccepted(int /*listen_fd*/) {
+  return -1;
+}
+
+int IoUringPoller::TakeReceived(int /*target_fd*/, char* /*buf*/, size_t /*len*/) {
+  return -1;
+}
+
+bool IoUringPoller::Send(int /*target_fd*/, const struct iovec* /*iov*/, size_t /*iov_count*/,
+                         bool /*more*/) {
+  return false;
+}
+
+ssize_t IoUringPoller::TakeSent(int /*target_fd*/) {
+  return -1;
+}
+
+#endif  // HAVE_LINUX_IO_URING_H
+
+}  // namespace epoll_server
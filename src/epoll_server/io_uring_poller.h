@@ -0,0 +1,238 @@
+#ifndef EPOLL_SERVER_IO_URING_POLLER_H_
+#define EPOLL_SERVER_IO_URING_POLLER_H_
+
+#include <sys/socket.h>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "epoll_server/poller.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace epoll_server {
+
+// The io_uring backend of the poller. It's completion based if the kernel supports multishot
+// receive (Linux 6.0+):
+// - The listening fd has a multishot accept in flight. The accepted sockets are queued until
+//   the event loop takes them.
+// - A socket has a multishot receive in flight while reading. The data is received into the
+//   buffers provided to the kernel by a buffer ring, and copied into the read buffer of the
+//   connection when it's taken. Pausing reading cancels the receive.
+// - The gather sends of the connections are queued and submitted in batch.
+// - Other fds such as the eventfd, and a socket waiting writable to sendfile, have a
+//   IORING_OP_POLL_ADD request in flight. A completed poll request is reported as an epoll
+//   event and re-armed at the next Poll(), after the event loop has handled it, so the events
+//   are level triggered as epoll.
+// On the older kernels, the sockets are polled for readiness too.
+// All the requests are submitted in batch with the waiting of completions, so one io_uring_enter
+// replaces the epoll_wait, the epoll_ctl, the recv and the sendmsg calls of a loop.
+
+class IoUringPoller : public Poller {
+public:
+  IoUringPoller();
+  ~IoUringPoller() override;
+
+  // Return false if io_uring is not supported by the system.
+  bool Create() override;
+
+  int Poll(int waiting_ms = -1) override;
+
+  const struct epoll_event& GetEvent(size_t index) const override;
+
+  bool Add(int target_fd, uint32_t events, void* ptr) override;
+
+  bool Modify(int target_fd, uint32_t events, void* ptr) override;
+
+  bool Remove(int target_fd) override;
+
+  bool AddAcceptor(int listen_fd, void* ptr) override;
+
+  bool AddSocket(int target_fd, uint32_t events, void* ptr) override;
+
+  bool CompletionBased() const override {
+    return completion_based_;
+  }
+
+  int TakeAccepted(int listen_fd) override;
+
+  int TakeReceived(int target_fd, char* buf, size_t len) override;
+
+  bool Send(int target_fd, const struct iovec* iov, size_t iov_count, bool more) override;
+
+  ssize_t TakeSent(int target_fd) override;
+
+private:
+  // The same as the gather write of the connections.
+  static const size_t kMaxSendIovecs = 128;
+
+  enum Kind {
+    kKindPoll = 0,
+    kKindAcceptor,
+    kKindSocket
+  };
+
+  struct Registration {
+    void* ptr;
+    uint32_t events;
+    Kind kind;
+
+    // Increased when the fd is added or removed, to identify the stale completions.
+    uint32_t generation;
+
+    // Increased when the poll request is modified too.
+    uint32_t poll_generation;
+
+    bool registered;
+
+    // A poll request is in flight.
+    bool armed;
+
+    // A multishot accept or receive is in flight.
+    bool multishot_armed;
+
+    // The multishot receive is being cancelled to pause reading.
+    bool cancelling;
+
+    // The peer closed or the receive failed. It's reported after the received data is taken.
+    bool eof;
+    int error;
+
+    // The received buffers not taken yet, linked by buffer id. -1 means none.
+    int32_t recv_head;
+    int32_t recv_tail;
+    uint32_t recv_offset;
+
+    // The index of the send in flight, or -1.
+    int32_t send_op;
+    bool send_completed;
+    int32_t send_result;
+
+    // The event of the fd in the current round of Poll(), so the completions of the same fd are
+    // reported by one event.
+    uint32_t event_round;
+    uint32_t event_index;
+  };
+
+  // A gather send in flight. The message header and the iovecs are kept until it's completed.
+  struct SendOp {
+    int fd;
+    uint32_t generation;
+    struct msghdr msg;
+    struct iovec iov[kMaxSendIovecs];
+  };
+
+  // The sockets accepted on a listening fd and not taken yet.
+  struct AcceptQueue {
+    int listen_fd;
+    std::deque<int> fds;
+  };
+
+  // Return nullptr if the submission queue is full.
+  struct io_uring_sqe* GetSqe();
+
+  // Publish the submission entry got by GetSqe().
+  void CommitSqe();
+
+  Registration* Find(int fd);
+  Registration* Register(int fd, Kind kind, uint32_t events, void* ptr);
+
+  // Submit the requests the registration needs but doesn't have in flight.
+  void Arm(int fd, Registration* reg);
+
+  bool PrepPollAdd(int fd, Registration* reg);
+  bool PrepPollRemove(int fd, const Registration& reg);
+  bool PrepAccept(int fd, Registration* reg);
+  bool PrepRecv(int fd, Registration* reg);
+  bool PrepCancel(uint64_t user_data);
+
+  // Submit the queued requests and wait for min_complete completions at most waiting_ms.
+  int Enter(unsigned min_complete, int waiting_ms);
+
+  int ReapCompletions();
+
+  void HandlePollCompletion(const struct io_uring_cqe& cqe);
+  void HandleAcceptCompletion(const struct io_uring_cqe& cqe);
+  void HandleRecvCompletion(const struct io_uring_cqe& cqe);
+  void HandleSendCompletion(const struct io_uring_cqe& cqe);
+
+  // Report the events of the registration. Return false if the events array is full.
+  bool ReportEvents(Registration* reg, uint32_t events);
+
+  bool SetupBufferRing();
+
+  // Return false if multishot receive is not supported.
+  bool ProbeMultishotRecv();
+
+  char* RecvBuffer(uint16_t bid) const;
+
+  // Give the receive buffer back to the kernel.
+  void RecycleBuffer(uint16_t bid);
+
+  void ReleaseReceived(Registration* reg);
+
+  AcceptQueue* FindAcceptQueue(int listen_fd);
+
+private:
+  int fd_;
+
+  void* sq_ring_;
+  size_t sq_ring_size_;
+  void* cq_ring_;
+  size_t cq_ring_size_;
+  struct io_uring_sqe* sqes_;
+  size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  struct io_uring_cqe* cqes_;
+
+  // Local tail of submission queue and the count of requests not submitted.
+  unsigned sq_local_tail_;
+  unsigned to_submit_;
+
+  bool completion_based_;
+
+  // The buffers provided to the multishot receives.
+  struct io_uring_buf_ring* buf_ring_;
+  size_t buf_ring_size_;
+  char* recv_buffers_;
+  size_t recv_buffers_size_;
+  uint16_t buf_ring_tail_;
+
+  // Indexed by buffer id.
+  std::vector<int32_t> buffer_next_;
+  std::vector<uint32_t> buffer_len_;
+
+  // The sockets whose receives ended because no buffer is left. They are re-armed after some
+  // buffers are given back.
+  std::vector<int> starved_fds_;
+
+  std::vector<std::unique_ptr<SendOp>> send_ops_;
+  std::vector<int32_t> free_send_ops_;
+
+  std::vector<AcceptQueue> accept_queues_;
+
+  // Indexed by fd.
+  std::vector<Registration> registrations_;
+
+  // The fds whose requests should be armed at the next Poll().
+  std::vector<int> rearm_fds_;
+
+  uint32_t event_round_;
+  int event_count_;
+  struct epoll_event events_[kMaxEpollEvents];
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_IO_URING_POLLER_H_
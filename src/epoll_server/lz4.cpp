@@ -0,0 +1,244 @@
+#include "epoll_server/lz4.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace epoll_server {
+
+namespace lz4 {
+
+// Sequence = Token + [LiteralLength] + Literals + Offset + [MatchLength].
+// The high 4 bits of the token is the literal length, the low 4 bits is the match length minus
+// kMinMatch. 15 means the length continues in the following bytes, each adds up to 255.
+// The last sequence has only literals.
+
+static const size_t kMinMatch = 4;
+
+// The last 5 bytes are always literals, and the last match starts 12 bytes before the end at
+// least.
+static const size_t kLastLiterals = 5;
+static const size_t kMatchFindLimit = 12;
+
+static const size_t kMaxOffset = 65535;
+
+// The hash table has at most 2^kHashLog entries, and fewer for the short input, so it's cheap
+// to clear.
+static const int kHashLog = 12;
+static const int kMinHashLog = 6;
+
+// Skip faster after many failed searches in the incompressible data.
+static const int kSkipTrigger = 6;
+
+static inline uint32_t Read32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint32_t Hash(uint32_t sequence, int hash_log) {
+  return (sequence * 2654435761U) >> (32 - hash_log);
+}
+
+// Write the rest of the length which is 15 or more.
+static inline uint8_t* WriteLength(uint8_t* op, size_t len) {
+  len -= 15;
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+
+  *op++ = static_cast<uint8_t>(len);
+  return op;
+}
+
+// Return the bytes of the sequence except the literals.
+static inline size_t SequenceOverhead(size_t literal_len, size_t match_len) {
+  return 1 + (literal_len >= 15 ? literal_len / 255 + 1 : 0) + 2 +
+         (match_len >= 15 ? match_len / 255 + 1 : 0);
+}
+
+size_t CompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+size_t Compress(const char* src, size_t src_size, char* dst, size_t dst_capacity) {
+  const uint8_t* const begin = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* const end = begin + src_size;
+  const uint8_t* ip = begin;
+  const uint8_t* anchor = begin;
+
+  uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+  uint8_t* const op_end = op + dst_capacity;
+
+  if (src_size > kMatchFindLimit) {
+    const uint8_t* const match_find_limit = end - kMatchFindLimit;
+    const uint8_t* const match_limit = end - kLastLiterals;
+
+    int hash_log = kMinHashLog;
+    while (hash_log < kHashLog && (static_cast<size_t>(1) << hash_log) < src_size / 4) {
+      ++hash_log;
+    }
+
+    // The positions of the sequences. 0 is the beginning, which is checked like others.
+    uint32_t table[1 << kHashLog];
+    memset(table, 0, sizeof(uint32_t) << hash_log);
+
+    size_t misses = 0;
+    ++ip;
+    while (ip < match_find_limit) {
+      uint32_t sequence = Read32(ip);
+      uint32_t hash = Hash(sequence, hash_log);
+      const uint8_t* ref = begin + table[hash];
+      table[hash] = static_cast<uint32_t>(ip - begin);
+
+      if (static_cast<size_t>(ip - ref) > kMaxOffset || Read32(ref) != sequence) {
+        ip += 1 + (misses++ >> kSkipTrigger);
+        continue;
+      }
+
+      misses = 0;
+
+      // Extend the match backward into the literals and forward.
+      while (ip > anchor && ref > begin && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+
+      const uint8_t* match_end = ip + kMinMatch;
+      ref += kMinMatch;
+      while (match_end < match_limit && *match_end == *ref) {
+        ++match_end;
+        ++ref;
+      }
+
+      size_t literal_len = static_cast<size_t>(ip - anchor);
+      size_t match_len = static_cast<size_t>(match_end - ip) - kMinMatch;
+      if (static_cast<size_t>(op_end - op) < literal_len + SequenceOverhead(literal_len, match_len)) {
+        return 0;
+      }
+
+      uint8_t* token = op++;
+      *token = static_cast<uint8_t>((literal_len >= 15 ? 15 : literal_len) << 4);
+      if (literal_len >= 15) {
+        op = WriteLength(op, literal_len);
+      }
+
+      memcpy(op, anchor, literal_len);
+      op += literal_len;
+
+      uint16_t offset = static_cast<uint16_t>(match_end - ref);
+      *op++ = static_cast<uint8_t>(offset);
+      *op++ = static_cast<uint8_t>(offset >> 8);
+
+      *token |= static_cast<uint8_t>(match_len >= 15 ? 15 : match_len);
+      if (match_len >= 15) {
+        op = WriteLength(op, match_len);
+      }
+
+      ip = match_end;
+      anchor = ip;
+    }
+  }
+
+  // The last literals.
+  size_t literal_len = static_cast<size_t>(end - anchor);
+  size_t overhead = 1 + (literal_len >= 15 ? literal_len / 255 + 1 : 0);
+  if (static_cast<size_t>(op_end - op) < literal_len + overhead) {
+    return 0;
+  }
+
+  uint8_t* token = op++;
+  *token = static_cast<uint8_t>((literal_len >= 15 ? 15 : literal_len) << 4);
+  if (literal_len >= 15) {
+    op = WriteLength(op, literal_len);
+  }
+
+  memcpy(op, anchor, literal_len);
+  op += literal_len;
+
+  return static_cast<size_t>(op - reinterpret_cast<uint8_t*>(dst));
+}
+
+// Return false if the input ends before the length.
+static inline bool ReadLength(const uint8_t** ip, const uint8_t* end, size_t* len) {
+  uint8_t byte;
+  do {
+    if (*ip >= end) {
+      return false;
+    }
+
+    byte = *(*ip)++;
+    *len += byte;
+  } while (byte == 255);
+
+  return true;
+}
+
+bool Decompress(const char* src, size_t src_size, char* dst, size_t dst_size) {
+  const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* const ip_end = ip + src_size;
+
+  uint8_t* const op_begin = reinterpret_cast<uint8_t*>(dst);
+  uint8_t* op = op_begin;
+  uint8_t* const op_end = op + dst_size;
+
+  while (ip < ip_end) {
+    uint8_t token = *ip++;
+
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && !ReadLength(&ip, ip_end, &literal_len)) {
+      return false;
+    }
+
+    if (literal_len > static_cast<size_t>(ip_end - ip) ||
+        literal_len > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+
+    memcpy(op, ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+
+    // The last sequence.
+    if (ip == ip_end) {
+      break;
+    }
+
+    if (ip_end - ip < 2) {
+      return false;
+    }
+
+    size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - op_begin)) {
+      return false;
+    }
+
+    size_t match_len = token & 15;
+    if (match_len == 15 && !ReadLength(&ip, ip_end, &match_len)) {
+      return false;
+    }
+
+    match_len += kMinMatch;
+    if (match_len > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+
+    // The match may overlap the output, so copy byte by byte if the offset is short.
+    const uint8_t* match = op - offset;
+    if (offset >= match_len) {
+      memcpy(op, match, match_len);
+      op += match_len;
+    } else {
+      for (size_t i = 0; i < match_len; ++i) {
+        *op++ = *match++;
+      }
+    }
+  }
+
+  return op == op_end;
+}
+
+}  // namespace lz4
+
+}  // namespace epoll_server
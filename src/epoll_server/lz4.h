@@ -0,0 +1,28 @@
+#ifndef EPOLL_SERVER_LZ4_H_
+#define EPOLL_SERVER_LZ4_H_
+
+#include <cstddef>
+
+namespace epoll_server {
+
+namespace lz4 {
+
+// A compressor of the LZ4 block format. It's greedy with a single hash table like the fast
+// mode of LZ4, and the output can be decompressed by any LZ4 block decoder.
+
+// The maximum compressed size of size bytes.
+size_t CompressBound(size_t size);
+
+// Return the compressed size, or 0 if dst_capacity is not enough.
+size_t Compress(const char* src, size_t src_size, char* dst, size_t dst_capacity);
+
+// The decompressed size must be exactly dst_size. Malformed input never reads or writes out of
+// the buffers.
+// Return false if the input is malformed.
+bool Decompress(const char* src, size_t src_size, char* dst, size_t dst_size);
+
+}  // namespace lz4
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_LZ4_H_
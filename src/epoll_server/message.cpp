@@ -1,44 +1,204 @@
 #include "epoll_server/message.h"
 
+#include <algorithm>
 #include <cassert>
+#include <thread>
 
+#include "epoll_server/buffer_pool.h"
 #include "epoll_server/connection.h"
 #include "epoll_server/crc32.h"
 #include "epoll_server/utils.h"
 #include "epoll_server/logging.h"
+#include "epoll_server/lz4.h"
+#include "epoll_server/noncopyable.h"
 
 namespace epoll_server {
 
+// The per thread pool of messages. The messages created by a thread are returned to the pool of
+// the same thread, even if they are released in other threads. The requests are created in the
+// I/O threads and released in the worker threads, and the responses are the opposite.
+class MessagePool : private Noncopyable {
+public:
+  // The free messages more than it are deleted.
+  static const size_t kMaxFreeMessages = 4096;
+
+  // The pool of the current thread. It's never destroyed, because its messages may be released
+  // in other threads after the thread exits.
+  static MessagePool* ThreadLocal() {
+    static thread_local MessagePool* pool = new MessagePool;
+    return pool;
+  }
+
+  Message* Get() {
+    if (free_messages_ == nullptr) {
+      free_messages_ = remote_free_messages_.exchange(nullptr, std::memory_order_acquire);
+      free_count_ = 0;
+      for (Message* msg = free_messages_; msg != nullptr; msg = msg->pool_next_) {
+        ++free_count_;
+      }
+    }
+
+    if (free_messages_ == nullptr) {
+      Message* msg = new Message;
+      msg->pool_ = this;
+      return msg;
+    }
+
+    Message* msg = free_messages_;
+    free_messages_ = msg->pool_next_;
+    --free_count_;
+
+    msg->pool_next_ = nullptr;
+    return msg;
+  }
+
+  // Thread safe.
+  void Put(Message* msg) {
+    if (std::this_thread::get_id() != owner_) {
+      Message* head = remote_free_messages_.load(std::memory_order_relaxed);
+      do {
+        msg->pool_next_ = head;
+      } while (!remote_free_messages_.compare_exchange_weak(head, msg, std::memory_order_release,
+                                                            std::memory_order_relaxed));
+      return;
+    }
+
+    if (free_count_ >= kMaxFreeMessages) {
+      delete msg;
+      return;
+    }
+
+    msg->pool_next_ = free_messages_;
+    free_messages_ = msg;
+    ++free_count_;
+  }
+
+private:
+  MessagePool()
+      : owner_(std::this_thread::get_id())
+      , free_messages_(nullptr)
+      , free_count_(0)
+      , remote_free_messages_(nullptr) {
+  }
+
+private:
+  std::thread::id owner_;
+
+  // Only used in the owner thread.
+  Message* free_messages_;
+  size_t free_count_;
+
+  // The messages released in other threads. The owner thread takes them all at once.
+  std::atomic<Message*> remote_free_messages_;
+};
+
+const uint16_t Message::kCodeOverloaded;
+const uint16_t Message::kCodeTooLong;
+const uint16_t Message::kMaxV1DataLength;
+const uint16_t Message::kHeaderLen;
+const uint16_t Message::kV2HeaderLen;
+const uint8_t Message::kFlagMore;
+const uint8_t Message::kFlagCompressed;
+
 Message::Message()
-    : conn_(nullptr)
-    , conn_timestamp_(0)
-    , data_len(0)
+    : data_len(0)
     , code(0)
-    , crc32(0) {
+    , crc32(0)
+    , refs_(0)
+    , pool_(nullptr)
+    , pool_next_(nullptr)
+    , conn_handle_(kInvalidConnectionHandle)
+    , version_(kVersion1)
+    , flags_(0)
+    , request_id_(0)
+    , accept_compression_(false)
+    , chunks_prepared_(false)
+    , seq_(0)
+    , placeholder_(false)
+    , has_more_(false)
+    , enqueue_us_(0) {
 }
 
-Message::Message(Connection* conn, uint16_t code_, std::string&& data_) {
-  assert(conn != nullptr);
+Message::Message(ConnectionHandle conn_handle, uint16_t code_, std::string&& data_)
+    : refs_(0)
+    , pool_(nullptr)
+    , pool_next_(nullptr)
+    , version_(kVersion1)
+    , flags_(0)
+    , request_id_(0)
+    , accept_compression_(false)
+    , chunks_prepared_(false)
+    , seq_(0)
+    , placeholder_(false)
+    , has_more_(false)
+    , enqueue_us_(0) {
+  Assign(conn_handle, code_, std::move(data_));
+}
 
+MessagePtr Message::Create() {
+  return MessagePtr(MessagePool::ThreadLocal()->Get());
+}
+
+MessagePtr Message::Create(ConnectionHandle conn_handle, uint16_t code_, std::string&& data_) {
+  MessagePtr msg = Create();
+  msg->Assign(conn_handle, code_, std::move(data_));
+  return msg;
+}
+
+void Message::Unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  if (pool_ == nullptr) {
+    delete this;
+    return;
+  }
+
+  // Release the payload and the response data before pooling.
+  Reset();
+  pool_->Put(this);
+}
+
+void Message::Assign(ConnectionHandle conn_handle, uint16_t code_, std::string&& data_) {
   data = std::move(data_);
-  data_len = static_cast<uint16_t>(data.size());
+  data_len = static_cast<uint32_t>(data.size());
   code = code_;
   crc32 = CalcCRC32(data);
-  conn_ = conn;
-  conn_timestamp_ = conn_->timestamp();
+  conn_handle_ = conn_handle;
 }
 
-bool Message::Valid() const {
-  if (conn_ == nullptr) {
-    return false;
-  }
+void Message::Reset() {
+  data_len = 0;
+  code = 0;
+  crc32 = 0;
 
+  // The capacity is not kept for reuse. The data is replaced by the moved response string in
+  // Assign(), which frees the kept buffer anyway, so it's freed now and the pooled messages hold
+  // no memory.
+  std::string().swap(data);
+  payload.Clear();
+  file_.reset();
+  conn_handle_ = kInvalidConnectionHandle;
+  version_ = kVersion1;
+  flags_ = 0;
+  request_id_ = 0;
+  accept_compression_ = false;
+  chunks_prepared_ = false;
+  chunks_.clear();
+  seq_ = 0;
+  placeholder_ = false;
+  has_more_ = false;
+  enqueue_us_ = 0;
+}
+
+bool Message::Valid() const {
   if (IsExpired()) {
     SPDLOG_WARN("Expired message.");
     return false;
   }
 
-  if (data_len != data.size()) {
+  if (data_len != payload.size()) {
     SPDLOG_DEBUG("Invaid Request");
     return false;
   }
@@ -49,7 +209,7 @@ bool Message::Valid() const {
     return false;
   }
 
-  if (data_len !=0  && crc32 != CalcCRC32(data)) {
+  if (data_len !=0  && crc32 != CalcCRC32(payload.data(), payload.size())) {
     SPDLOG_DEBUG("Invaid Request");
     return false;
   }
@@ -58,39 +218,160 @@ bool Message::Valid() const {
 }
 
 bool Message::IsExpired() const {
-  if (conn_ == nullptr) {
-    return true;
-  }
+  // The message is expired because the connection is closed or its slot is reused by a new
+  // connection.
+  return conn() == nullptr;
+}
 
-  // The message is expired because the related conn_ is closed or reused by new connection.
-  if (conn_timestamp_ != conn_->timestamp()) {
-    return true;
-  }
+Connection* Message::conn() const {
+  return ConnectionTable::GetInstance()->Find(conn_handle_);
+}
 
-  return false;
+EventLoop* Message::loop() const {
+  return ConnectionTable::GetInstance()->GetLoop(conn_handle_);
 }
 
-void Message::Unpack(Connection* conn, const char header[8], std::string&& data_) {
+void Message::Unpack(Connection* conn, const char header[8], Slice&& payload_) {
   assert(conn != nullptr);
 
-  conn_ = conn;
-  conn_timestamp_ = conn->timestamp();
+  conn_handle_ = conn->handle();
 
   data_len = BytesToUint16(kLittleEndian, &header[0]);
   code = BytesToUint16(kLittleEndian, &header[2]);
   crc32 = BytesToUint32(kLittleEndian, &header[4]);
-  data = std::move(data_);
+  payload = std::move(payload_);
 }
 
-std::string Message::Pack() const {
-  std::string buf;
+void Message::UnpackV2(Connection* conn, const char header[24], Slice&& payload_) {
+  assert(conn != nullptr);
+
+  conn_handle_ = conn->handle();
+
+  version_ = static_cast<uint8_t>(header[2]);
+  flags_ = static_cast<uint8_t>(header[3]);
+  code = BytesToUint16(kLittleEndian, &header[4]);
+  data_len = BytesToUint32(kLittleEndian, &header[8]);
+  request_id_ = static_cast<uint64_t>(BytesToUint32(kLittleEndian, &header[12])) |
+                static_cast<uint64_t>(BytesToUint32(kLittleEndian, &header[16])) << 32;
+  crc32 = BytesToUint32(kLittleEndian, &header[20]);
+  payload = std::move(payload_);
+}
+
+void Message::PackHeader(char header[8]) const {
+  assert(data_len <= kMaxV1DataLength);
+  Uint16ToBytes(kLittleEndian, data_len, &header[0]);
+  Uint16ToBytes(kLittleEndian, code, &header[2]);
+  Uint32ToBytes(kLittleEndian, crc32, &header[4]);
+}
+
+bool Message::Decompress(size_t max_size) {
+  if ((flags_ & kFlagCompressed) == 0) {
+    return true;
+  }
+
+  // The CRC32 is of the compressed bytes. Check it before decompressing.
+  if (payload.size() < 4 || crc32 != CalcCRC32(payload.data(), payload.size())) {
+    return false;
+  }
+
+  uint32_t original_len = BytesToUint32(kLittleEndian, payload.data());
+  if (original_len > max_size) {
+    return false;
+  }
+
+  BufferBlock* block = BufferPool::ThreadLocal()->Get(original_len);
+  bool ok = lz4::Decompress(payload.data() + 4, payload.size() - 4, block->data(), original_len);
+  if (ok) {
+    payload = Slice(block, block->data(), original_len);
+    data_len = original_len;
+    crc32 = CalcCRC32(payload.data(), payload.size());
+    flags_ &= ~kFlagCompressed;
+  }
+
+  block->Unref();
+  return ok;
+}
+
+void Message::PackHeaderV2(char header[24], uint8_t flags, uint32_t chunk_len,
+                           uint32_t chunk_crc32) const {
+  Uint16ToBytes(kLittleEndian, kV2Magic, &header[0]);
+  header[2] = static_cast<char>(kVersion2);
+  header[3] = static_cast<char>(flags);
+  Uint16ToBytes(kLittleEndian, code, &header[4]);
+  Uint16ToBytes(kLittleEndian, 0, &header[6]);
+  Uint32ToBytes(kLittleEndian, chunk_len, &header[8]);
+  Uint32ToBytes(kLittleEndian, static_cast<uint32_t>(request_id_), &header[12]);
+  Uint32ToBytes(kLittleEndian, static_cast<uint32_t>(request_id_ >> 32), &header[16]);
+  Uint32ToBytes(kLittleEndian, chunk_crc32, &header[20]);
+}
+
+void Message::set_file(FileRangePtr file) {
+  data.clear();
+  data_len = file ? file->length() : 0;
+  crc32 = file ? file->crc32() : 0;
+  file_ = std::move(file);
+}
+
+void Message::ReplyTo(const Message& request) {
+  seq_ = request.seq_;
+  version_ = request.version_;
+  flags_ = request.flags_ & kFlagMore;
+  request_id_ = request.request_id_;
+  accept_compression_ = request.accept_compression_;
+}
+
+// Compressed chunk = OriginalLen(4) + LZ4 block.
+// Return false if the compressed chunk is not shorter.
+static bool CompressChunk(const char* data, size_t len, Slice* body) {
+  if (len <= 8) {
+    return false;
+  }
+
+  BufferBlock* block = BufferPool::ThreadLocal()->Get(len);
+  Uint32ToBytes(kLittleEndian, static_cast<uint32_t>(len), block->data());
+
+  // Sended as it is if the compression doesn't save.
+  size_t compressed_len = lz4::Compress(data, len, block->data() + 4, len - 5);
+  if (compressed_len > 0) {
+    *body = Slice(block, block->data(), 4 + compressed_len);
+  }
+
+  block->Unref();
+  return compressed_len > 0;
+}
+
+void Message::PrepareChunks(size_t max_chunk_length, size_t compression_threshold) {
+  if (chunks_prepared_) {
+    return;
+  }
+
+  chunks_prepared_ = true;
+  if (version_ != kVersion2 || file_ || placeholder_) {
+    return;
+  }
+
+  // An empty response is one empty chunk.
+  size_t offset = 0;
+  do {
+    size_t len = std::min(data.size() - offset, max_chunk_length);
+
+    Chunk chunk;
+    chunk.offset = static_cast<uint32_t>(offset);
+    chunk.len = static_cast<uint32_t>(len);
 
-  buf += Uint16ToBytes(kLittleEndian, data_len);
-  buf += Uint16ToBytes(kLittleEndian, code);
-  buf += Uint32ToBytes(kLittleEndian, crc32);
-  buf += data;
+    // The CRC32 of the whole data is calculated already.
+    chunk.crc32 = crc32;
+    if (accept_compression_ && compression_threshold > 0 && len >= compression_threshold &&
+        CompressChunk(data.data() + offset, len, &chunk.body)) {
+      chunk.len = static_cast<uint32_t>(chunk.body.size());
+      chunk.crc32 = CalcCRC32(chunk.body.data(), chunk.body.size());
+    } else if (len != data.size()) {
+      chunk.crc32 = CalcCRC32(data.data() + offset, len);
+    }
 
-  return buf;
+    chunks_.push_back(std::move(chunk));
+    offset += len;
+  } while (offset < data.size());
 }
 
 }  // namespace epoll_server
@@ -1,61 +1,277 @@
 #ifndef EPOLL_SERVER_MESSAGE_H_
 #define EPOLL_SERVER_MESSAGE_H_
 
+#include <atomic>
 #include <string>
-#include <memory>
+#include <vector>
+
+#include "epoll_server/connection_table.h"
+#include "epoll_server/file_range.h"
+#include "epoll_server/intrusive_ptr.h"
+#include "epoll_server/mpsc_queue.h"
+#include "epoll_server/slice.h"
 
 namespace epoll_server {
 
 class Connection;
+class EventLoop;
+class Message;
+class MessagePool;
+
+using MessagePtr = IntrusivePtr<Message>;
 
 // Message = Header + Body.
 // Header = DataLength + MsgCode + Crc32.
 // Message Bytes = DataLen(LittleEndian) + MsgCode(LittleEndian) + CRC32(LittleEndian) + Data.
+//
+// Protocol v2 frame. All the fields are little endian.
+// Frame Bytes = Magic(2) + Version(1) + Flags(1) + MsgCode(2) + Reserved(2) + ChunkLen(4) +
+//               RequestId(8) + CRC32(4) + Chunk.
+// The magic 0xFFFF is the v1 data length never accepted, so both protocols are served on the
+// same port. A large payload is sended as several chunks of the same request id, and every
+// chunk but the last has kFlagMore. Every chunk is a message with its own CRC32. The responses
+// have the version and the request id of their requests.
+// A chunk with kFlagCompressed = OriginalLen(4) + LZ4 block. Its CRC32 is of the compressed
+// bytes. The responses are compressed only if the client sends kFlagAcceptCompression.
+//
+// The messages are reference counted by MessagePtr. The messages created by Create() are reused
+// by the pool of the creating thread after the last reference is released.
 
-class Message {
+class Message : public MpscNode<Message> {
 public:
-  uint16_t data_len;  // Data length.
+  uint32_t data_len;  // Data length. The chunk length in protocol v2.
   uint16_t code;  // Distinguish commands.
   uint32_t crc32;  // Data check number.
 
+  // The response data.
   std::string data;
 
+  // The request data. It refers to the receive buffer of the connection without copy, and
+  // keeps the buffer block from being reused. Copy it by ToString() if it's kept for long.
+  Slice payload;
+
 public:
   // HeaderLen = sizeof(data_len) + sizeof(code) + sizeof(crc32)
   const static uint16_t kHeaderLen = 8;
 
+  const static uint16_t kV2HeaderLen = 24;
+  const static uint16_t kV2Magic = 0xFFFF;
+
+  // The data length of v1 is 16 bits, and kV2Magic starts a v2 frame.
+  const static uint16_t kMaxV1DataLength = kV2Magic - 1;
+
+  const static uint8_t kVersion1 = 1;
+  const static uint8_t kVersion2 = 2;
+
+  // The flags of protocol v2. More chunks of the request or more responses follow.
+  const static uint8_t kFlagMore = 0x01;
+  const static uint8_t kFlagCompressed = 0x02;
+  const static uint8_t kFlagAcceptCompression = 0x04;
+
+  // The reserved code of the response to the request rejected by overload. No router can be
+  // added for it.
+  const static uint16_t kCodeOverloaded = 0xFFFF;
+
+  // The reserved code of the empty response sended instead of a v1 response longer than
+  // kMaxV1DataLength.
+  const static uint16_t kCodeTooLong = 0xFFFE;
+
+  // A chunk of the v2 response data.
+  struct Chunk {
+    uint32_t offset;
+    // The length sended, which is of the compressed body if compressed.
+    uint32_t len;
+    uint32_t crc32;
+
+    // The compressed chunk which is sended instead of the range of data. Empty if not compressed.
+    Slice body;
+  };
+
   Message();
 
-  Message(Connection* conn, uint16_t code_, std::string&& data_);
+  Message(ConnectionHandle conn_handle, uint16_t code_, std::string&& data_);
+
+  // Return a message from the pool of the current thread.
+  static MessagePtr Create();
+  static MessagePtr Create(ConnectionHandle conn_handle, uint16_t code_, std::string&& data_);
+
+  // Thread safe. Used by MessagePtr.
+  void Ref() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Unref();
 
   bool Valid() const;
 
   bool IsExpired() const;
 
-  void Unpack(Connection* conn, const char header[8], std::string&& data_);
+  void Unpack(Connection* conn, const char header[8], Slice&& payload_);
+  void UnpackV2(Connection* conn, const char header[24], Slice&& payload_);
+
+  // Decompress the payload with kFlagCompressed into a pooled buffer block.
+  // Return false if the payload is corrupted or decompressed longer than max_size.
+  bool Decompress(size_t max_size);
+
+  // Write the header into the caller's memory. The data is sended after the header without
+  // copy.
+  void PackHeader(char header[8]) const;
+
+  // Write the v2 header of the chunk of data_len bytes.
+  void PackHeaderV2(char header[24], uint8_t flags, uint32_t chunk_len, uint32_t chunk_crc32) const;
 
-  std::string Pack() const;
+  // Take the sequence number, the protocol version and the request id of the request. The
+  // response to a chunk with kFlagMore has kFlagMore too.
+  void ReplyTo(const Message& request);
+
+  // Split the v2 response data into chunks of max_chunk_length bytes at most, and compress the
+  // chunks of at least compression_threshold bytes if the client accepts compression. It's
+  // called by the thread building the response, so the I/O thread only frames the chunks. The
+  // data should not be changed after it. Calling it again does nothing.
+  void PrepareChunks(size_t max_chunk_length, size_t compression_threshold);
+
+  // Empty for the responses of protocol v1 and the file responses.
+  const std::vector<Chunk>& chunks() const {
+    return chunks_;
+  }
+
+  // The connection is referred by handle, so the message expires once the connection is closed
+  // or its slot is reused.
+  ConnectionHandle conn_handle() const {
+    return conn_handle_;
+  }
+
+  void set_conn_handle(ConnectionHandle conn_handle) {
+    conn_handle_ = conn_handle;
+  }
+
+  // Return nullptr if the connection is expired. Only used in the I/O thread of the connection.
+  Connection* conn() const;
+
+  // Thread safe. The event loop of the connection, even if the connection is expired.
+  EventLoop* loop() const;
+
+  // The sequence number of the request on its connection in ordered response mode. The
+  // response has the same sequence number as its request. 0 means no ordering.
+  uint64_t seq() const {
+    return seq_;
+  }
+
+  void set_seq(uint64_t seq) {
+    seq_ = seq;
+  }
+
+  // A placeholder response takes the place of the request without response in ordered
+  // response mode. Nothing is sended for it.
+  bool placeholder() const {
+    return placeholder_;
+  }
+
+  void set_placeholder(bool placeholder) {
+    placeholder_ = placeholder;
+  }
 
-  Connection* conn() const {
-    return conn_;
+  // More responses of the same request follow this one. Only the last response finishes the
+  // request.
+  bool has_more() const {
+    return has_more_;
   }
 
-  void set_conn(Connection* conn) {
-    conn_ = conn;
+  void set_has_more(bool has_more) {
+    has_more_ = has_more;
   }
 
-  void set_conn_timestamp(int64_t conn_timestamp) {
-    conn_timestamp_ = conn_timestamp;
+  uint8_t version() const {
+    return version_;
+  }
+
+  void set_version(uint8_t version) {
+    version_ = version;
+  }
+
+  // The flags of protocol v2.
+  uint8_t flags() const {
+    return flags_;
+  }
+
+  void set_flags(uint8_t flags) {
+    flags_ = flags;
+  }
+
+  // The request is a chunk and more chunks of it follow.
+  bool more_chunks() const {
+    return (flags_ & kFlagMore) != 0;
+  }
+
+  // Identify the request in protocol v2. It's chosen by the client.
+  uint64_t request_id() const {
+    return request_id_;
+  }
+
+  void set_request_id(uint64_t request_id) {
+    request_id_ = request_id;
+  }
+
+  // The client of the connection has sended kFlagAcceptCompression. The response takes it from
+  // the request.
+  bool accept_compression() const {
+    return accept_compression_;
+  }
+
+  void set_accept_compression(bool accept_compression) {
+    accept_compression_ = accept_compression;
+  }
+
+  // The response data is the file range instead of data. It's sended by sendfile as one frame,
+  // without chunking or compression.
+  const FileRangePtr& file() const {
+    return file_;
+  }
+
+  void set_file(FileRangePtr file);
+
+  // The steady microseconds when the request is queued to the thread pool.
+  int64_t enqueue_us() const {
+    return enqueue_us_;
+  }
+
+  void set_enqueue_us(int64_t enqueue_us) {
+    enqueue_us_ = enqueue_us;
   }
 
 private:
-  Connection* conn_;
+  friend class MessagePool;
 
-  // The connection may be expired, so use timestamp to idendify the original conection.
-  int64_t conn_timestamp_;
-};
+  void Assign(ConnectionHandle conn_handle, uint16_t code_, std::string&& data_);
 
-using MessagePtr = std::shared_ptr<Message>;
+  // Clear the fields for reuse.
+  void Reset();
+
+private:
+  std::atomic<int> refs_;
+
+  // The pool which the message returns to. nullptr if the message is not pooled.
+  MessagePool* pool_;
+  Message* pool_next_;
+
+  ConnectionHandle conn_handle_;
+
+  FileRangePtr file_;
+
+  uint8_t version_;
+  uint8_t flags_;
+  uint64_t request_id_;
+  bool accept_compression_;
+
+  bool chunks_prepared_;
+  std::vector<Chunk> chunks_;
+
+  uint64_t seq_;
+  bool placeholder_;
+  bool has_more_;
+
+  int64_t enqueue_us_;
+};
 
 }  // namespace epoll_server
 
@@ -0,0 +1,109 @@
+#ifndef EPOLL_SERVER_MPSC_QUEUE_H_
+#define EPOLL_SERVER_MPSC_QUEUE_H_
+
+#include <atomic>
+
+#include "epoll_server/intrusive_ptr.h"
+#include "epoll_server/noncopyable.h"
+
+namespace epoll_server {
+
+// The node of MpscQueue. The element type T should inherit from MpscNode<T>, and be reference
+// counted by IntrusivePtr<T>.
+template <class T>
+class MpscNode {
+public:
+  MpscNode() : mpsc_next_(nullptr) {
+  }
+
+private:
+  template <class U> friend class MpscQueue;
+
+  std::atomic<MpscNode*> mpsc_next_;
+};
+
+// Intrusive lock-free multi-producer single-consumer queue. (Dmitry Vyukov's algorithm.)
+// Push() is wait-free and can be called in any thread. Pop() and Empty() can only be called in
+// the consumer thread.
+
+template <class T>
+class MpscQueue : private Noncopyable {
+public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {
+  }
+
+  ~MpscQueue() {
+    while (Pop()) {
+    }
+  }
+
+  // The queue owns the reference of the element until it's popped.
+  void Push(IntrusivePtr<T> t) {
+    if (!t) {
+      return;
+    }
+
+    PushNode(t.release());
+  }
+
+  // Return nullptr if the queue is empty or the pushing of the next element is not finished.
+  IntrusivePtr<T> Pop() {
+    MpscNode<T>* tail = tail_;
+    MpscNode<T>* next = tail->mpsc_next_.load(std::memory_order_acquire);
+
+    if (tail == &stub_) {
+      if (next == nullptr) {
+        return IntrusivePtr<T>();
+      }
+
+      tail_ = next;
+      tail = next;
+      next = next->mpsc_next_.load(std::memory_order_acquire);
+    }
+
+    if (next != nullptr) {
+      tail_ = next;
+      return IntrusivePtr<T>(static_cast<T*>(tail), false);
+    }
+
+    // A producer has swapped the head but not linked it to the list yet.
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return IntrusivePtr<T>();
+    }
+
+    PushNode(&stub_);
+
+    next = tail->mpsc_next_.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      tail_ = next;
+      return IntrusivePtr<T>(static_cast<T*>(tail), false);
+    }
+
+    return IntrusivePtr<T>();
+  }
+
+  // Return false if some elements are pushed or being pushed.
+  bool Empty() const {
+    // The tail is the next element to pop unless it's the stub.
+    return tail_ == &stub_ && stub_.mpsc_next_.load(std::memory_order_acquire) == nullptr &&
+           head_.load(std::memory_order_acquire) == &stub_;
+  }
+
+private:
+  void PushNode(MpscNode<T>* node) {
+    node->mpsc_next_.store(nullptr, std::memory_order_relaxed);
+    MpscNode<T>* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->mpsc_next_.store(node, std::memory_order_release);
+  }
+
+private:
+  MpscNode<T> stub_;
+
+  // Producers push to head. Consumer pops from tail.
+  std::atomic<MpscNode<T>*> head_;
+  MpscNode<T>* tail_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_MPSC_QUEUE_H_
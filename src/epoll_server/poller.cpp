@@ -0,0 +1,29 @@
+#include "epoll_server/poller.h"
+
+#include "epoll_server/epoller.h"
+#include "epoll_server/io_uring_poller.h"
+#include "epoll_server/logging.h"
+
+namespace epoll_server {
+
+PollerPtr CreatePoller(const std::string& backend) {
+  if (backend == "io_uring") {
+    PollerPtr poller(new IoUringPoller);
+    if (poller->Create()) {
+      return poller;
+    }
+
+    SPDLOG_WARN("Failed to create io_uring poller. Fall back to epoll.");
+  } else if (backend != "epoll") {
+    SPDLOG_WARN("Unknown I/O backend: {}. Use epoll.", backend);
+  }
+
+  PollerPtr poller(new Epoller);
+  if (!poller->Create()) {
+    return PollerPtr();
+  }
+
+  return poller;
+}
+
+}  // namespace epoll_server
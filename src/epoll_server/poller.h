@@ -0,0 +1,96 @@
+#ifndef EPOLL_SERVER_POLLER_H_
+#define EPOLL_SERVER_POLLER_H_
+
+#include <sys/epoll.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+
+namespace epoll_server {
+
+const size_t kMaxEpollEvents = 1024;
+
+// Poller is the I/O multiplexing backend of the event loop. The events are reported as
+// struct epoll_event whatever the backend is.
+//
+// A completion based backend accepts, receives and sends on the sockets by itself. The events
+// report the completions instead of the readiness: EPOLLIN when some connections are accepted or
+// some data is received, EPOLLOUT when a send is completed. The connections take the results
+// from the poller instead of calling accept4, recv and sendmsg.
+
+class Poller {
+public:
+  virtual ~Poller() = default;
+
+  virtual bool Create() = 0;
+
+  // waiting_ms > 0: Waiting timeout.
+  // waiting_ms = 0: Return immediately.
+  // waiting_ms = -1: Block until receive evets.
+  // Return >= 0: Received events count.
+  // Return < 0: Error.
+  virtual int Poll(int waiting_ms = -1) = 0;
+
+  virtual const struct epoll_event& GetEvent(size_t index) const = 0;
+
+  // Register the target fd on the poller.
+  virtual bool Add(int target_fd, uint32_t events, void* ptr) = 0;
+
+  // Change the the event of target fd.
+  virtual bool Modify(int target_fd, uint32_t events, void* ptr) = 0;
+
+  // Unregister the target fd. It should be called before the fd is closed.
+  virtual bool Remove(int target_fd) = 0;
+
+  // Register the listening fd.
+  virtual bool AddAcceptor(int listen_fd, void* ptr) {
+    return Add(listen_fd, EPOLLIN, ptr);
+  }
+
+  // Register the connected socket. The completion based backend receives while EPOLLIN is in
+  // the events, and polls only for EPOLLOUT.
+  virtual bool AddSocket(int target_fd, uint32_t events, void* ptr) {
+    return Add(target_fd, events, ptr);
+  }
+
+  virtual bool CompletionBased() const {
+    return false;
+  }
+
+  // Completion based only. Return a non-blocking socket accepted on the listening fd, or -1 if
+  // no more.
+  virtual int TakeAccepted(int /*listen_fd*/) {
+    return -1;
+  }
+
+  // Completion based only. Copy at most len received bytes into buf, just like sock::Recv.
+  // Return 0 if no data is received yet, or -1 if the peer closed or some errors occurred.
+  virtual int TakeReceived(int /*target_fd*/, char* /*buf*/, size_t /*len*/) {
+    return -1;
+  }
+
+  // Completion based only. Submit a gather send at the next Poll(). One send of a fd is in
+  // flight at a time, and the buffers should be kept until it's completed.
+  virtual bool Send(int /*target_fd*/, const struct iovec* /*iov*/, size_t /*iov_count*/,
+                    bool /*more*/) {
+    return false;
+  }
+
+  // Completion based only. Return the sended bytes of the completed send, 0 if the send is
+  // still in flight, or -1 if it failed.
+  virtual ssize_t TakeSent(int /*target_fd*/) {
+    return -1;
+  }
+};
+
+using PollerPtr = std::unique_ptr<Poller>;
+
+// Backend: "epoll" or "io_uring". Fall back to epoll if io_uring is not supported.
+// Return nullptr if failed to create the poller.
+PollerPtr CreatePoller(const std::string& backend);
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_POLLER_H_
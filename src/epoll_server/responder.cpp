@@ -0,0 +1,78 @@
+#include "epoll_server/responder.h"
+
+#include "epoll_server/config.h"
+#include "epoll_server/connection_table.h"
+#include "epoll_server/event_loop.h"
+
+namespace epoll_server {
+
+Responder::Responder(const MessagePtr& request)
+    : conn_handle_(request->conn_handle())
+    , code_(request->code)
+    , seq_(request->seq())
+    , version_(request->version())
+    , flags_(request->flags() & Message::kFlagMore)
+    , request_id_(request->request_id())
+    , accept_compression_(request->accept_compression())
+    , finished_(false) {
+}
+
+Responder::~Responder() {
+  Finish();
+}
+
+bool Responder::Alive() const {
+  return ConnectionTable::GetInstance()->Find(conn_handle_) != nullptr;
+}
+
+bool Responder::Send(std::string&& data) {
+  return Respond(std::move(data), true, false);
+}
+
+bool Responder::Finish(std::string&& data) {
+  return Respond(std::move(data), false, false);
+}
+
+bool Responder::FinishFile(FileRangePtr file) {
+  return Respond(std::string(), false, false, std::move(file));
+}
+
+bool Responder::Finish() {
+  return Respond(std::string(), false, true);
+}
+
+bool Responder::Respond(std::string&& data, bool has_more, bool placeholder, FileRangePtr file) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finished_) {
+      return false;
+    }
+
+    finished_ = !has_more;
+  }
+
+  // The response to the closed connection is dropped anyway.
+  if (!Alive()) {
+    return false;
+  }
+
+  MessagePtr response = Message::Create(conn_handle_, code_, std::move(data));
+  response->set_seq(seq_);
+  response->set_version(version_);
+  response->set_flags(flags_);
+  response->set_request_id(request_id_);
+  response->set_accept_compression(accept_compression_);
+  response->set_has_more(has_more);
+  response->set_placeholder(placeholder);
+  if (file) {
+    response->set_file(std::move(file));
+  }
+
+  // Compress in the current thread. The response is sended in the I/O thread which the
+  // connection belongs to.
+  response->PrepareChunks(CONFIG.max_chunk_length, CONFIG.compression_threshold);
+  response->loop()->AddResponse(std::move(response));
+  return true;
+}
+
+}  // namespace epoll_server
@@ -0,0 +1,60 @@
+#ifndef EPOLL_SERVER_RESPONDER_H_
+#define EPOLL_SERVER_RESPONDER_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "epoll_server/message.h"
+#include "epoll_server/noncopyable.h"
+
+namespace epoll_server {
+
+// The handle to respond a request later, used by the asynchronous routers. It can be used in any
+// thread and kept after the router returns.
+// A request can be responded several times by Send() for streaming, and is finished by Finish().
+// If the responder is destroyed without finishing, the request is finished without response.
+
+class Responder : private Noncopyable {
+public:
+  explicit Responder(const MessagePtr& request);
+
+  ~Responder();
+
+  // Return false if the connection of the request is closed or reused.
+  bool Alive() const;
+
+  // Send a response and more responses will follow.
+  // Return false if the connection is closed or the request is finished.
+  bool Send(std::string&& data);
+
+  // Send the last response.
+  bool Finish(std::string&& data);
+
+  // Send the range of file as the last response by sendfile.
+  bool FinishFile(FileRangePtr file);
+
+  // Finish the request without response.
+  bool Finish();
+
+private:
+  bool Respond(std::string&& data, bool has_more, bool placeholder, FileRangePtr file = nullptr);
+
+private:
+  ConnectionHandle conn_handle_;
+  uint16_t code_;
+  uint64_t seq_;
+  uint8_t version_;
+  uint8_t flags_;
+  uint64_t request_id_;
+  bool accept_compression_;
+
+  std::mutex mutex_;
+  bool finished_;
+};
+
+using ResponderPtr = std::shared_ptr<Responder>;
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_RESPONDER_H_
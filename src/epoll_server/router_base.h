@@ -4,7 +4,9 @@
 #include <string>
 #include <memory>
 
+#include "epoll_server/file_range.h"
 #include "epoll_server/message.h"
+#include "epoll_server/responder.h"
 
 namespace epoll_server {
 
@@ -16,6 +18,31 @@ public:
   virtual std::string HandleRequest(MessagePtr msg) = 0;
 };
 
+// The asynchronous router doesn't return the response. It responds by the responder later, so
+// the worker thread is not blocked while waiting for timers or upstream calls.
+class AsyncRouterBase : public RouterBase {
+public:
+  virtual void HandleRequest(MessagePtr msg, ResponderPtr responder) = 0;
+
+  // Not used for the asynchronous router.
+  std::string HandleRequest(MessagePtr /*msg*/) final {
+    return std::string();
+  }
+};
+
+// The router responds a range of file, which is sended by sendfile without reading it into
+// the response data.
+class FileRouterBase : public RouterBase {
+public:
+  // Return nullptr to respond empty data.
+  virtual FileRangePtr HandleFileRequest(MessagePtr msg) = 0;
+
+  // Not used for the file router.
+  std::string HandleRequest(MessagePtr /*msg*/) final {
+    return std::string();
+  }
+};
+
 using RouterPtr = std::shared_ptr<RouterBase>;
 
 }  // namespace epoll_server
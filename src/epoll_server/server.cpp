@@ -4,7 +4,6 @@
 #include <signal.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
-#include <sys/eventfd.h>
 #include <sys/errno.h>
 
 #include "epoll_server/crc32.h"
@@ -12,15 +11,19 @@
 #include "epoll_server/logging.h"
 #include "epoll_server/utils.h"
 #include "epoll_server/connection.h"
+#include "epoll_server/connection_table.h"
 #include "epoll_server/message.h"
 #include "epoll_server/process.h"
+#include "epoll_server/socket_options.h"
 
 namespace epoll_server {
 
 Server::Server()
     : acceptor_fd_(-1)
-    , wakener_fd_(-1)
-    , time_wheel_scheduler_(50) {
+    , rejected_requests_(0)
+    , shed_requests_(0)
+    , time_wheel_scheduler_(50)
+    , routers_frozen_(false) {
 }
 
 bool Server::Init(int argc, char** argv, const std::string& config_path) {
@@ -57,8 +60,19 @@ void Server::Start() {
   StartServer();
 }
 
-void Server::AddRouter(uint16_t msg_code, RouterPtr router) {
+void Server::AddRouter(uint16_t msg_code, RouterPtr router, bool run_inline) {
+  if (msg_code == Message::kCodeOverloaded || msg_code == Message::kCodeTooLong) {
+    SPDLOG_ERROR("The msg code {} is reserved.", msg_code);
+    return;
+  }
+
+  if (routers_frozen_.load()) {
+    SPDLOG_ERROR("The router of msg code {} is added after starting.", msg_code);
+    return;
+  }
+
   routers_[msg_code] = router;
+  inline_routers_[msg_code] = run_inline;
 }
 
 uint32_t Server::CreateTimerAt(int64_t when_ms, const TimerTask& task) {
@@ -80,50 +94,46 @@ void Server::CancelTimer(uint32_t timer_id) {
 bool Server::StartServer() {
   SPDLOG_TRACK_METHOD;
 
-  connection_pool_.reset(new ConnectionPool(CONFIG.connection_pool_size));
-
-  if (!epoller_.Create()) {
-    return false;
-  }
+  FreezeRouters();
 
-  acceptor_connection_.reset(new Connection(acceptor_fd_, Connection::kTypeAcceptor));
-  acceptor_connection_->SetReadEvent(true);
-  if (!epoller_.Add(acceptor_connection_->fd(), acceptor_connection_->epoll_events(),
-      static_cast<void*>(acceptor_connection_.get()))) {
-    return false;
-  }
-
-  wakener_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
-  if (wakener_fd_ == -1) {
-    SPDLOG_ERROR("Failed to create eventfd instance.");
-    return false;
-  }
-
-  wakener_connection_.reset(new Connection(wakener_fd_, Connection::kTypeWakener));
-  wakener_connection_->SetReadEvent(true);
-  if (!epoller_.Add(wakener_connection_->fd(), wakener_connection_->epoll_events(),
-      static_cast<void*>(wakener_connection_.get()))) {
+  if (!InitEventLoops()) {
     return false;
   }
 
+  request_codel_.reset(new Codel(CONFIG.request_queue_target_ms * 1000,
+                                 CONFIG.request_queue_interval_ms * 1000));
+  request_thread_pool_.set_capacity(CONFIG.request_queue_capacity);
   request_thread_pool_.Start(CONFIG.thread_pool_size, [this](MessagePtr msg) {
-    HandleRequest(msg);
+    HandleRequest(std::move(msg));
   });
 
   time_wheel_scheduler_.Start([this](TimerPtr timer) {
     HandleTimeWheelScheduler(timer);
   });
 
-  for (;;) {
-    if (!PollOnce()) {
-      return false;
-    }
+  for (size_t i = 1; i < event_loops_.size(); ++i) {
+    EventLoop* event_loop = event_loops_[i].get();
+    io_threads_.emplace_back([event_loop]() {
+      event_loop->Loop();
+    });
+  }
+
+  event_loops_[0]->Loop();
+
+  // The other loops use the connection table and the thread pool, so they are stopped first.
+  for (size_t i = 1; i < event_loops_.size(); ++i) {
+    event_loops_[i]->Quit();
   }
 
+  for (auto& io_thread : io_threads_) {
+    io_thread.join();
+  }
+  io_threads_.clear();
+
   request_thread_pool_.StopAndWait();
   time_wheel_scheduler_.Stop();
 
-  return true;
+  return false;
 }
 
 bool Server::StartMasterAndWorkers() {
@@ -196,258 +206,218 @@ void Server::StartWorker() {
 }
 
 bool Server::InitAcceptor() {
+  acceptor_fd_ = CreateAcceptor();
+  return acceptor_fd_ != -1;
+}
+
+int Server::CreateAcceptor() {
   // SOCK_STREAM: TCP. Sequenced, reliable, connection-based byte streams.
   // SOCK_CLOEXEC: Atomically set close-on-exec flag for the new descriptor(s).
-  acceptor_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
-  if (acceptor_fd_ == -1) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
     SPDLOG_ERROR("Failed to create socket.");
-    return false;
+    return -1;
   }
 
   // Enable SO_REUSEADDR option to avoid that TIME_WAIT prevents the server restarting.
-  if (!sock::SetReuseAddr(acceptor_fd_)) {
+  if (!sock::SetReuseAddr(fd)) {
     SPDLOG_ERROR("Failed to set SO_REUSEADDR");
-    return false;
+    close(fd);
+    return -1;
   }
 
-  if (!sock::SetReuseAddr(acceptor_fd_)) {
+  // Enable SO_REUSEPORT option to let every event loop listen the same port with its own
+  // acceptor. The kernel balances the incoming connections between the acceptors.
+  if (!sock::SetReusePort(fd)) {
     SPDLOG_ERROR("Failed to set SO_REUSEPORT");
-    return false;
+    close(fd);
+    return -1;
   }
 
   // Set the acceptor to be non-blocking to avoid calling accept() to block too much time.
-  if (!sock::SetNonBlocking(acceptor_fd_)) {
+  if (!sock::SetNonBlocking(fd)) {
     SPDLOG_ERROR("Faild to set socket to be non-blocking.");
-    return false;
+    close(fd);
+    return -1;
   }
 
-  if (!sock::Bind(acceptor_fd_, CONFIG.port)) {
+  SetListenSocketOptions(fd);
+
+  if (!sock::Bind(fd, CONFIG.port)) {
     SPDLOG_ERROR("Failed to bind port: {}.", CONFIG.port);
-    return false;
+    close(fd);
+    return -1;
   }
 
-  const int kListenBacklog = 511;
-  if (listen(acceptor_fd_, kListenBacklog) == -1) {
+  int backlog = CONFIG.listen_backlog > 0 ? static_cast<int>(CONFIG.listen_backlog) : SOMAXCONN;
+  if (listen(fd, backlog) == -1) {
     SPDLOG_ERROR("Failed to listen.");
-    return false;
+    close(fd);
+    return -1;
   }
 
-  return true;
+  return fd;
 }
 
-bool Server::PollOnce() {
-  int n = epoller_.Poll();
-  if (n == -1 ) {
-    return false;
-  }
+bool Server::InitEventLoops() {
+  size_t io_thread_count = CONFIG.io_thread_count > 0 ? CONFIG.io_thread_count : 1;
 
-  for (int i = 0; i < n; ++i) {
-    auto event = epoller_.GetEvent(i);
-    Connection* conn = static_cast<Connection*>(event.data.ptr);
-    if (conn == nullptr) {
-      SPDLOG_WARN("Unexpected epoll event.");
-      continue;
-    }
+  // The connection pool size is the total of all the loops, which are in one slab.
+  size_t connection_pool_size = (CONFIG.connection_pool_size + io_thread_count - 1) / io_thread_count;
+  ConnectionTable::GetInstance()->Init(io_thread_count * connection_pool_size);
 
-    // The connection may be closed by preivous event.
-    if (conn->fd() == -1) {
-      SPDLOG_DEBUG("Expired event.");
-      continue;
+  for (size_t i = 0; i < io_thread_count; ++i) {
+    // The first event loop uses the acceptor created in Init(), which is shared by the
+    // worker processes in master-worker mode. The others create their own acceptors.
+    int acceptor_fd = i == 0 ? acceptor_fd_ : CreateAcceptor();
+    if (acceptor_fd == -1) {
+      return false;
     }
 
-    // The socket is disconected if receive EPOLLERR or EPOLLRDHUP.
-    if (event.events & (EPOLLIN | EPOLLERR | EPOLLRDHUP)) {
-      if (conn->type() == Connection::kTypeAcceptor) {
-        HandleAccpet(conn);
-      } else if (conn->type() == Connection::kTypeSocket) {
-        HandleRead(conn);
-      } else if (conn->type() == Connection::kTypeWakener) {
-        conn->HandleWakeUp();
-      }
-      continue;
+    std::unique_ptr<EventLoop> event_loop(new EventLoop);
+    if (!event_loop->Init(acceptor_fd, connection_pool_size)) {
+      return false;
     }
 
-    if (event.events & EPOLLOUT) {
-      // The EPOLLOUT event will be triggered constantly if the socket is writable.
-      // So if the data is sened completely, the EPOLLOUT event should be removed from epoll.
-      if (conn->HandleWrite()) {
-        conn->SetWriteEvent(false);
-        epoller_.Modify(conn->fd(), conn->epoll_events(), static_cast<void*>(conn));
-      }
-    }
-  }
+    event_loop->set_request_handler([this](MessagePtr request) {
+      AddRequest(std::move(request));
+    });
+    event_loop->set_on_connected(on_connected_);
+    event_loop->set_on_disconnected(on_disconnected_);
 
-  HandlePendingResponses();
-  HandlePendingTimers();
+    event_loops_.push_back(std::move(event_loop));
+  }
 
+  SPDLOG_DEBUG("Init {} event loops.", event_loops_.size());
+  SPDLOG_DEBUG("CRC32 kernel: {}.", GetCrc32KernelName(GetCrc32Kernel()));
   return true;
 }
 
-// In I/O thread.
-void Server::HandleAccpet(Connection* conn) {
-  if (conn == nullptr) {
-    return;
-  }
-
-  struct sockaddr_in sock_addr;
-  int fd = conn->HandleAccept(&sock_addr);
-  if (fd == -1) {
+void Server::AddRequest(MessagePtr request) {
+  // The inline router is cheap, so the request is handled in the I/O thread without handoff.
+  const RouterEntry& entry = FindRouter(request->code);
+  if (entry.run_inline) {
+    MessagePtr response = request->Valid() ? RouteRequest(request, entry) : MakePlaceholder(request);
+    if (response) {
+      request->loop()->SendResponse(std::move(response));
+    }
     return;
   }
 
-  char remote_ip[30] = { 0 };
-  inet_ntop(AF_INET,&sock_addr.sin_addr, remote_ip, sizeof(remote_ip));
-  unsigned short remote_port = ntohs(sock_addr.sin_port);
-
-  if (!sock::SetNonBlocking(fd)) {
-    SPDLOG_WARN("Failed to SetNonBlocking. Remote addr: {}:{}.", remote_ip, remote_port);
-    close(fd);
+  request->set_enqueue_us(GetSteadyMicroseconds());
+  if (request_thread_pool_.Add(std::move(request))) {
     return;
   }
 
-  if (!sock::SetClosexc(fd)) {
-    SPDLOG_WARN("Failed to SetClosexc. Remote addr: {}:{}.", remote_ip, remote_port);
-    close(fd);
-    return;
-  }
+  rejected_requests_.fetch_add(1, std::memory_order_relaxed);
+  SPDLOG_DEBUG("Request queue is full. Msg code:{}.", request->code);
+  request->loop()->SendResponse(RejectRequest(request));
+}
 
-  Connection* new_conn = connection_pool_->Get();
-  if (new_conn == nullptr) {
-    SPDLOG_WARN("Connection pool is empty. Remote addr: {}:{}.", remote_ip, remote_port);
-    return;
-  }
+void Server::FreezeRouters() {
+  routers_frozen_.store(true);
 
-  new_conn->set_fd(fd);
-  new_conn->set_remote_ip(remote_ip);
-  new_conn->set_remote_port(remote_port);
-  new_conn->SetReadEvent(true);
+  // The reserved codes have no router, so the indexes fit in 16 bits.
+  router_entries_.assign(1, RouterEntry());
+  router_table_.assign(static_cast<size_t>(UINT16_MAX) + 1, 0);
+  for (const auto& router : routers_) {
+    if (!router.second) {
+      continue;
+    }
 
-  if (!epoller_.Add(new_conn->fd(), new_conn->epoll_events(), static_cast<void*>(new_conn))) {
-    SPDLOG_ERROR("Failed to update epoll event. Remote addr: {}:{}.", remote_ip, remote_port);
-    connection_pool_->Release(conn);
-    return;
-  }
+    RouterEntry entry;
+    entry.router = router.second.get();
+    entry.async_router = dynamic_cast<AsyncRouterBase*>(entry.router);
+    entry.file_router = dynamic_cast<FileRouterBase*>(entry.router);
+    entry.run_inline = inline_routers_[router.first];
 
-  if (on_connected_) {
-    on_connected_(new_conn);
+    router_table_[router.first] = static_cast<uint16_t>(router_entries_.size());
+    router_entries_.push_back(entry);
   }
 }
 
-// In I/O thread.
-void Server::HandleRead(Connection* conn) {
-  MessagePtr request;
-  if (!conn->HandleRead(&request)) {
-    if (on_disconnected_) {
-      on_disconnected_(conn);
-    }
-
-    connection_pool_->Release(conn);
-    return;
-  }
-
+// Use thread pool to handle requests.
+void Server::HandleRequest(MessagePtr request) {
   if (!request) {
     return;
   }
 
-  request_thread_pool_.Add(std::move(request));
-}
-
-// In I/O thread.
-void Server::HandlePendingResponses() {
-  std::vector<MessagePtr> responses;
-  {
-    std::lock_guard<std::mutex> lock(pending_response_mutex_);
-    responses.swap(pending_responses_);
+  if (!request->Valid()) {
+    request->loop()->AddResponse(MakePlaceholder(request));
+    return;
   }
 
-  for (auto response : responses) {
-    if (!response) {
-      continue;
-    }
-
-    if (response->IsExpired()) {
-      SPDLOG_DEBUG("Expired reponse.");
-      continue;
-    }
-
-    Connection* conn = response->conn();
-    std::string buf = std::move(response->Pack());
-    size_t sended_size = 0;
-
-    int n = sock::Send(conn->fd(), &buf[0], buf.size(), &sended_size);
-    // Send error.
-    if (n == -1) {
-      SPDLOG_ERROR("Failed to send data.");
-      continue;
-    }
-
-    // System write buffer is full. It should wait the writable event.
-    if (n == 0) {
-      conn->SetSendData(std::move(buf), sended_size);
-      conn->SetWriteEvent(true);
-      epoller_.Modify(conn->fd(), conn->epoll_events(), static_cast<void*>(conn));
-    }
+  // Shed the request before handling, the caller probably has given up.
+  int64_t now_us = GetSteadyMicroseconds();
+  if (request_codel_->Overloaded(now_us - request->enqueue_us(), now_us)) {
+    shed_requests_.fetch_add(1, std::memory_order_relaxed);
+    SPDLOG_DEBUG("Request is shed. Msg code:{}. Queued {} us.", request->code,
+                 now_us - request->enqueue_us());
+    request->loop()->AddResponse(RejectRequest(request));
+    return;
   }
-}
 
-// In I/O thread.
-void Server::HandlePendingTimers() {
-  std::vector<TimerPtr> timers;
-  {
-    std::lock_guard<std::mutex> lock(pending_timer_mutex_);
-    timers.swap(pending_timers_);
+  MessagePtr response = RouteRequest(request, FindRouter(request->code));
+  if (!response) {
+    return;
   }
 
-  for (TimerPtr timer : timers) {
-    timer->Run();
-  }
+  // Compress in the worker thread. The response is sended in the I/O thread which the
+  // connection belongs to.
+  response->PrepareChunks(CONFIG.max_chunk_length, CONFIG.compression_threshold);
+  request->loop()->AddResponse(std::move(response));
 }
 
-// Use thread pool to handle requests.
-void Server::HandleRequest(MessagePtr request) {
-  if (!request && !request->Valid()) {
-    return;
+MessagePtr Server::RouteRequest(const MessagePtr& request, const RouterEntry& entry) {
+  if (entry.async_router != nullptr) {
+    entry.async_router->HandleRequest(request, std::make_shared<Responder>(request));
+    return MessagePtr();
   }
 
-  auto it = routers_.find(request->code);
-  if (it == routers_.end()) {
+  RouterBase* router = entry.router;
+  if (router == nullptr) {
     SPDLOG_WARN("No msg router. Msg code:{}.", request->code);
-    return;
+    return MakePlaceholder(request);
   }
 
-  RouterPtr router = it->second;
-  if (!router) {
-    SPDLOG_WARN("No msg router. Msg code:{}.", request->code);
-    return;
+  if (entry.file_router != nullptr) {
+    MessagePtr response = Message::Create(request->conn_handle(), request->code, std::string());
+    response->ReplyTo(*request);
+    response->set_file(entry.file_router->HandleFileRequest(request));
+    return response;
   }
 
   std::string response_data = router->HandleRequest(request);
-  MessagePtr response = std::make_shared<Message>(request->conn(), request->code, std::move(response_data));
-  {
-    std::lock_guard<std::mutex> lock(pending_response_mutex_);
-    pending_responses_.push_back(std::move(response));
-  }
+  MessagePtr response = Message::Create(request->conn_handle(), request->code, std::move(response_data));
+  response->ReplyTo(*request);
 
-  // Wake up epoll_wait to handle pending responses.
-  WakeUp();
+  // Nothing is sended for the empty response to a chunk which is not the last one.
+  if (request->more_chunks() && response->data.empty()) {
+    response->set_placeholder(true);
+  }
+  return response;
 }
 
-void Server::HandleTimeWheelScheduler(TimerPtr timer) {
-  {
-    std::lock_guard<std::mutex> lock(pending_timer_mutex_);
-    pending_timers_.push_back(timer);
+MessagePtr Server::RejectRequest(const MessagePtr& request) {
+  if (CONFIG.overload_action == "drop") {
+    return MakePlaceholder(request);
   }
 
-  // Wake up epoll_wait to handle pending timers.
-  WakeUp();
+  MessagePtr response = Message::Create(request->conn_handle(), Message::kCodeOverloaded, std::string());
+  response->ReplyTo(*request);
+  return response;
 }
 
-void Server::WakeUp() {
-  uint64_t one = 1;
-  ssize_t n = write(wakener_fd_, &one, sizeof(one));
-  if (n != sizeof(one)) {
-    SPDLOG_ERROR("Failed to wakeup.");
-  }
+MessagePtr Server::MakePlaceholder(const MessagePtr& request) {
+  MessagePtr response = Message::Create(request->conn_handle(), request->code, std::string());
+  response->ReplyTo(*request);
+  response->set_placeholder(true);
+  return response;
+}
+
+void Server::HandleTimeWheelScheduler(TimerPtr timer) {
+  // Run the timers in the first I/O thread.
+  event_loops_[0]->AddTimer(timer);
 }
 
 void Server::InitTimeWheelScheduler() {
@@ -1,13 +1,14 @@
 #ifndef EPOLL_SERVER_SERVER_H_
 #define EPOLL_SERVER_SERVER_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <unordered_map>
 
+#include "epoll_server/codel.h"
 #include "epoll_server/connection.h"
-#include "epoll_server/connection_pool.h"
-#include "epoll_server/epoller.h"
+#include "epoll_server/event_loop.h"
 #include "epoll_server/thread_pool.h"
 #include "epoll_server/router_base.h"
 #include "epoll_server/message.h"
@@ -16,7 +17,8 @@
 
 namespace epoll_server {
 
-// The network I/O are in the same thread. The business logic is handled in thread pool.
+// The network I/O are handled by one or more event loops, one I/O thread per loop.
+// The business logic is handled in thread pool.
 
 class Server {
 public:
@@ -28,7 +30,12 @@ public:
 
   void Start();
 
-  void AddRouter(uint16_t msg_code, RouterPtr router);
+  // An inline router runs in the I/O thread and its response is sended without any thread
+  // handoff. It should only be used for the cheap and non-blocking routers, because it blocks
+  // all the connections of the I/O thread.
+  // An AsyncRouterBase router responds by the responder later, instead of returning the response.
+  // The routers should be added before Start(). The router table is immutable after starting.
+  void AddRouter(uint16_t msg_code, RouterPtr router, bool run_inline = false);
 
   void set_on_connected(const std::function<void(Connection*)>& on_connected) {
     on_connected_ = on_connected;
@@ -45,7 +52,43 @@ public:
 
   void CancelTimer(uint32_t timer_id);
 
+  // The count of requests rejected because the request queue is full.
+  uint64_t rejected_requests() const {
+    return rejected_requests_.load(std::memory_order_relaxed);
+  }
+
+  // The count of requests shed because they are queued too long when overloaded.
+  uint64_t shed_requests() const {
+    return shed_requests_.load(std::memory_order_relaxed);
+  }
+
+  // The event loops created in Init(), one per I/O thread. Their counters can be read in any
+  // thread.
+  size_t event_loop_count() const {
+    return event_loops_.size();
+  }
+
+  const EventLoop& event_loop(size_t index) const {
+    return *event_loops_[index];
+  }
+
 private:
+  struct RouterEntry {
+    RouterEntry()
+        : router(nullptr), async_router(nullptr), file_router(nullptr), run_inline(false) {
+    }
+
+    RouterBase* router;
+
+    // Not null if the router is asynchronous.
+    AsyncRouterBase* async_router;
+
+    // Not null if the router responds file ranges.
+    FileRouterBase* file_router;
+
+    bool run_inline;
+  };
+
   bool StartServer();
 
   bool StartMasterAndWorkers();
@@ -54,49 +97,67 @@ private:
 
   bool InitAcceptor();
 
-  bool PollOnce();
+  // Return a non-blocking listening socket bound with SO_REUSEADDR and SO_REUSEPORT.
+  // Return -1 if some errors occurred.
+  int CreateAcceptor();
 
-  // The accecpt, read and write operations are in the same thread.
-  void HandleAccpet(Connection* conn);
-  void HandleRead(Connection* conn);
-  
-  void HandlePendingResponses();
+  bool InitEventLoops();
 
-  void HandlePendingTimers();
+  // Build the direct indexed router table from the added routers.
+  void FreezeRouters();
+
+  const RouterEntry& FindRouter(uint16_t msg_code) const {
+    return router_entries_[router_table_[msg_code]];
+  }
+
+  // In I/O thread. Queue the request to the thread pool, or reject it if the queue is full.
+  void AddRequest(MessagePtr request);
 
   // Use thread pool to handle requests.
   void HandleRequest(MessagePtr request);
 
-  void HandleTimeWheelScheduler(TimerPtr timer);
+  // Return the response of the router, or a placeholder if no router.
+  // Return nullptr if the router is asynchronous and responds by itself.
+  MessagePtr RouteRequest(const MessagePtr& request, const RouterEntry& entry);
+
+  // Return the response of the overloaded code, or a placeholder if the overloaded requests are
+  // dropped. The caller sends it in the I/O thread, or adds it to the loop in a worker thread.
+  MessagePtr RejectRequest(const MessagePtr& request);
+
+  // Nothing is sended for the placeholder. It finishes the request in the connection, so the
+  // in flight requests and the reorder window don't stall.
+  MessagePtr MakePlaceholder(const MessagePtr& request);
 
-  // Trigger a epoll event and wake up epoll_wait.
-  void WakeUp();
+  void HandleTimeWheelScheduler(TimerPtr timer);
 
   void InitTimeWheelScheduler();
 
 private:
   int acceptor_fd_;
-  std::unique_ptr<Connection> acceptor_connection_;
-
-  int wakener_fd_;
-  std::unique_ptr<Connection> wakener_connection_;
-
-  Epoller epoller_;
 
-  std::unique_ptr<ConnectionPool> connection_pool_;
+  // The first event loop runs in the thread calling Start(). The others run in io_threads_.
+  std::vector<std::unique_ptr<EventLoop>> event_loops_;
+  std::vector<std::thread> io_threads_;
 
-  ThreadPool<Message> request_thread_pool_;
+  ThreadPool<Message, MessagePtr> request_thread_pool_;
 
-  std::mutex pending_response_mutex_;
-  std::vector<MessagePtr> pending_responses_;
-
-  std::mutex pending_timer_mutex_;
-  std::vector<TimerPtr> pending_timers_;
+  std::unique_ptr<Codel> request_codel_;
+  std::atomic<uint64_t> rejected_requests_;
+  std::atomic<uint64_t> shed_requests_;
 
   TimeWheelScheduler time_wheel_scheduler_;
 
-  // The key is Message Code.
+  // Own the added routers. The key is Message Code.
   std::unordered_map<uint16_t, RouterPtr> routers_;
+  std::unordered_map<uint16_t, bool> inline_routers_;
+
+  // The entries of the added routers. The first one is empty for the codes without router.
+  std::vector<RouterEntry> router_entries_;
+
+  // 65536 indexes of the entries, indexed by Message Code. Both are built at starting and only
+  // read after, so dispatching is two loads without lock or reference counting.
+  std::vector<uint16_t> router_table_;
+  std::atomic<bool> routers_frozen_;
 
   std::function<void(Connection*)> on_connected_;
   std::function<void(Connection*)> on_disconnected_;
@@ -0,0 +1,84 @@
+#ifndef EPOLL_SERVER_SLICE_H_
+#define EPOLL_SERVER_SLICE_H_
+
+#include <cstddef>
+#include <string>
+
+#include "epoll_server/buffer_pool.h"
+
+namespace epoll_server {
+
+// A read only view of the bytes in a buffer block. It holds a reference of the block, so the
+// bytes are valid until the slice is destroyed. Copying a slice doesn't copy the bytes.
+
+class Slice {
+public:
+  Slice() : block_(nullptr), data_(nullptr), size_(0) {
+  }
+
+  Slice(BufferBlock* block, const char* data, size_t size)
+      : block_(block), data_(data), size_(size) {
+    if (block_ != nullptr) {
+      block_->Ref();
+    }
+  }
+
+  Slice(const Slice& other) : block_(other.block_), data_(other.data_), size_(other.size_) {
+    if (block_ != nullptr) {
+      block_->Ref();
+    }
+  }
+
+  Slice(Slice&& other) : block_(other.block_), data_(other.data_), size_(other.size_) {
+    other.block_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  ~Slice() {
+    Clear();
+  }
+
+  Slice& operator=(Slice other) {
+    std::swap(block_, other.block_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // Copy the bytes.
+  std::string ToString() const {
+    return std::string(data_, size_);
+  }
+
+  void Clear() {
+    if (block_ != nullptr) {
+      block_->Unref();
+    }
+
+    block_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+private:
+  BufferBlock* block_;
+  const char* data_;
+  size_t size_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_SLICE_H_
@@ -0,0 +1,64 @@
+#include "epoll_server/socket_options.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "epoll_server/config.h"
+#include "epoll_server/logging.h"
+#include "epoll_server/utils.h"
+
+namespace epoll_server {
+
+// Set the option if the value is not 0.
+static void SetOption(int fd, int level, int option, int value, const char* name) {
+  if (value == 0) {
+    return;
+  }
+
+  if (!sock::SetIntOption(fd, level, option, value)) {
+    SPDLOG_WARN("Failed to set {} to {}. Error: {}.", name, value, strerror(errno));
+  }
+}
+
+void SetListenSocketOptions(int fd) {
+  // The accepted sockets inherit the buffer sizes. Setting them before listen() lets the
+  // window scale match the receive buffer.
+  SetOption(fd, SOL_SOCKET, SO_SNDBUF, CONFIG.send_buffer_size, "SO_SNDBUF");
+  SetOption(fd, SOL_SOCKET, SO_RCVBUF, CONFIG.receive_buffer_size, "SO_RCVBUF");
+
+  // Don't wake up the acceptor until the first data arrives.
+  SetOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, CONFIG.tcp_defer_accept_sec, "TCP_DEFER_ACCEPT");
+
+  // Accept the data in SYN from the clients with a fast open cookie.
+  SetOption(fd, IPPROTO_TCP, TCP_FASTOPEN, CONFIG.tcp_fast_open_queue, "TCP_FASTOPEN");
+}
+
+void SetAcceptedSocketOptions(int fd) {
+  SetOption(fd, IPPROTO_TCP, TCP_NODELAY, CONFIG.tcp_no_delay, "TCP_NODELAY");
+  SetOption(fd, IPPROTO_TCP, TCP_QUICKACK, CONFIG.tcp_quick_ack, "TCP_QUICKACK");
+
+  // Keep the unsent bytes in the socket small, so the outbound queue holds the rest and the
+  // watermarks see the real backlog.
+  SetOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, CONFIG.tcp_not_sent_lowat, "TCP_NOTSENT_LOWAT");
+
+  // Busy poll the device queue in blocking reads and poll. It needs CAP_NET_ADMIN to exceed
+  // net.core.busy_read.
+  SetOption(fd, SOL_SOCKET, SO_BUSY_POLL, CONFIG.busy_poll_us, "SO_BUSY_POLL");
+
+  if (CONFIG.keep_alive) {
+    SetOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+    SetOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, CONFIG.keep_alive_idle_sec, "TCP_KEEPIDLE");
+    SetOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, CONFIG.keep_alive_interval_sec, "TCP_KEEPINTVL");
+    SetOption(fd, IPPROTO_TCP, TCP_KEEPCNT, CONFIG.keep_alive_count, "TCP_KEEPCNT");
+  }
+}
+
+void SetQuickAck(int fd) {
+  sock::SetIntOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+}
+
+}  // namespace epoll_server
@@ -0,0 +1,21 @@
+#ifndef EPOLL_SERVER_SOCKET_OPTIONS_H_
+#define EPOLL_SERVER_SOCKET_OPTIONS_H_
+
+namespace epoll_server {
+
+// Apply the socket options of the config. A failed option is logged and skipped, because most
+// of them are optimizations which the system may not support.
+
+// Before listen().
+void SetListenSocketOptions(int fd);
+
+// After accept().
+void SetAcceptedSocketOptions(int fd);
+
+// Called after the first read of every read event if tcp_quick_ack is enabled. The kernel may
+// leave the quick ack mode. It's one setsockopt call each time.
+void SetQuickAck(int fd);
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_SOCKET_OPTIONS_H_
@@ -10,10 +10,18 @@
 
 namespace epoll_server {
 
-template <class T>
+// The elements are handled by TPtr, which is std::shared_ptr<T> by default. TPtr can be any
+// nullable smart pointer, and it's moved to the handler.
+template <class T, class TPtr = std::shared_ptr<T>>
 class ThreadPool {
 public:
-  using TPtr = std::shared_ptr<T>;
+  ThreadPool() : capacity_(0) {
+  }
+
+  // The maximum count of queued elements. 0 means unbounded.
+  void set_capacity(size_t capacity) {
+    capacity_ = capacity;
+  }
 
   void Start(size_t thread_size, std::function<void(TPtr t)>&& handler) {
     handler_ = std::move(handler);
@@ -37,12 +45,17 @@ public:
     queue_.Clear();
   }
 
-  void Add(TPtr&& t) {
+  // Return false if the queue is full. The element is not moved then.
+  bool Add(TPtr&& t) {
     if (!t) {
-      return;
+      return false;
     }
 
-    queue_.Push(std::move(t));
+    return queue_.TryPush(std::move(t), capacity_);
+  }
+
+  size_t QueueSize() const {
+    return queue_.Size();
   }
 
 private:
@@ -54,13 +67,14 @@ private:
         break;
       }
 
-      handler_(t);
+      handler_(std::move(t));
     }
   }
 
 private:
   std::vector<std::thread> threads_;
   ThreadSafeQueue<TPtr> queue_;
+  size_t capacity_;
   std::function<void(TPtr)> handler_;
 };
 
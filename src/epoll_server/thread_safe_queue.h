@@ -2,39 +2,86 @@
 #define EPOLL_SERVER_THREAD_SAFE_QUEUE_H_
 
 #include <condition_variable>
-#include <list>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 namespace epoll_server {
 
+// The elements are stored in a ring buffer, which grows when it's full and never shrinks. So
+// pushing and popping don't allocate memory in the steady state.
+
 template <class T>
 class ThreadSafeQueue {
 public:
+  ThreadSafeQueue() : ring_(kInitialCapacity), head_(0), size_(0) {
+  }
+
   void Push(T&& t) {
     std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push_back(std::forward<T>(t));
+    PushBack(std::forward<T>(t));
+    not_empty_cv_.notify_one();
+  }
+
+  // Return false if the queue has capacity elements. 0 means unbounded.
+  bool TryPush(T&& t, size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity != 0 && size_ >= capacity) {
+      return false;
+    }
+
+    PushBack(std::forward<T>(t));
     not_empty_cv_.notify_one();
+    return true;
   }
 
   T PopOrWait() {
     std::unique_lock<std::mutex> lock(mutex_);
     not_empty_cv_.wait(lock, [this]() {
-      return !queue_.empty();
+      return size_ != 0;
     });
 
-    T t = std::move(queue_.front());
-    queue_.pop_front();
+    T t = std::move(ring_[head_]);
+    head_ = (head_ + 1) % ring_.size();
+    --size_;
     return t;
   }
 
+  size_t Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+
   void Clear() {
     std::lock_guard<std::mutex> lock(mutex_);
-    queue_.clear();
+    for (; size_ > 0; --size_) {
+      ring_[head_] = T();
+      head_ = (head_ + 1) % ring_.size();
+    }
+    head_ = 0;
+  }
+
+private:
+  void PushBack(T&& t) {
+    if (size_ == ring_.size()) {
+      std::vector<T> ring(ring_.size() * 2);
+      for (size_t i = 0; i < size_; ++i) {
+        ring[i] = std::move(ring_[(head_ + i) % ring_.size()]);
+      }
+      ring_.swap(ring);
+      head_ = 0;
+    }
+
+    ring_[(head_ + size_) % ring_.size()] = std::forward<T>(t);
+    ++size_;
   }
 
 private:
-  std::list<T> queue_;
+  static const size_t kInitialCapacity = 64;
+
+  std::vector<T> ring_;
+  size_t head_;
+  size_t size_;
 
   mutable std::mutex mutex_;
   std::condition_variable not_empty_cv_;
@@ -0,0 +1,99 @@
+#include "epoll_server/timeout_wheel.h"
+
+namespace epoll_server {
+
+TimeoutWheel::TimeoutWheel(uint32_t slots, uint32_t tick_ms)
+    : tick_ms_(tick_ms > 0 ? tick_ms : 1)
+    , current_tick_(-1)
+    , slots_(slots > 0 ? slots : 1)
+    , size_(0) {
+  for (TimeoutNode& slot : slots_) {
+    slot.prev = &slot;
+    slot.next = &slot;
+  }
+}
+
+TimeoutWheel::~TimeoutWheel() {
+  for (TimeoutNode& slot : slots_) {
+    while (slot.next != &slot) {
+      Cancel(slot.next);
+    }
+  }
+}
+
+void TimeoutWheel::Schedule(TimeoutNode* node, int64_t expire_ms) {
+  Cancel(node);
+
+  // Round up, so the timeout never expires early.
+  node->tick = (expire_ms + tick_ms_ - 1) / tick_ms_;
+  if (current_tick_ >= 0 && node->tick <= current_tick_) {
+    node->tick = current_tick_ + 1;
+  }
+
+  Link(node);
+}
+
+void TimeoutWheel::Cancel(TimeoutNode* node) {
+  if (!node->linked) {
+    return;
+  }
+
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->prev = nullptr;
+  node->next = nullptr;
+  node->linked = false;
+  --size_;
+}
+
+void TimeoutWheel::Advance(int64_t now_ms, std::vector<TimeoutNode*>* expired) {
+  int64_t now_tick = now_ms / tick_ms_;
+  if (current_tick_ < 0) {
+    current_tick_ = now_tick;
+  }
+
+  if (now_tick <= current_tick_) {
+    return;
+  }
+
+  // Every slot is visited at most once, even if the loop is blocked for a long time.
+  int64_t from_tick = current_tick_ + 1;
+  if (now_tick - from_tick >= static_cast<int64_t>(slots_.size())) {
+    from_tick = now_tick - slots_.size() + 1;
+  }
+
+  current_tick_ = now_tick;
+
+  for (int64_t tick = from_tick; tick <= now_tick; ++tick) {
+    TimeoutNode* slot = &slots_[tick % slots_.size()];
+    TimeoutNode* node = slot->next;
+    while (node != slot) {
+      TimeoutNode* next = node->next;
+      if (node->tick <= now_tick) {
+        Cancel(node);
+        expired->push_back(node);
+      }
+      node = next;
+    }
+  }
+}
+
+int TimeoutWheel::NextTickMs(int64_t now_ms) const {
+  if (size_ == 0) {
+    return -1;
+  }
+
+  return static_cast<int>(tick_ms_ - now_ms % tick_ms_);
+}
+
+void TimeoutWheel::Link(TimeoutNode* node) {
+  TimeoutNode* slot = &slots_[node->tick % slots_.size()];
+  node->prev = slot->prev;
+  node->next = slot;
+  slot->prev->next = node;
+  slot->prev = node;
+  node->linked = true;
+  ++size_;
+}
+
+}  // namespace epoll_server
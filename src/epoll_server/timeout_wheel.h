@@ -0,0 +1,73 @@
+#ifndef EPOLL_SERVER_TIMEOUT_WHEEL_H_
+#define EPOLL_SERVER_TIMEOUT_WHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "epoll_server/noncopyable.h"
+
+namespace epoll_server {
+
+// The intrusive handle of a timeout. It's embedded in the owner object, so scheduling and
+// canceling a timeout is O(1) without allocation.
+struct TimeoutNode {
+  TimeoutNode() : prev(nullptr), next(nullptr), tick(0), linked(false), data(nullptr) {
+  }
+
+  TimeoutNode* prev;
+  TimeoutNode* next;
+
+  // The tick when the timeout expires.
+  int64_t tick;
+
+  bool linked;
+
+  // The owner object.
+  void* data;
+};
+
+// A single level hashed time wheel used by one thread. The slot of a timeout is its expiring
+// tick modulo the count of slots, so a timeout longer than the wheel stays in the slot for
+// several rounds.
+// The timeouts are expired at tick granularity and never earlier than the given time.
+
+class TimeoutWheel : private Noncopyable {
+public:
+  TimeoutWheel(uint32_t slots, uint32_t tick_ms);
+
+  ~TimeoutWheel();
+
+  // Schedule or reschedule the timeout.
+  void Schedule(TimeoutNode* node, int64_t expire_ms);
+
+  void Cancel(TimeoutNode* node);
+
+  // Move the timeouts expired before now into expired. They are removed from the wheel.
+  void Advance(int64_t now_ms, std::vector<TimeoutNode*>* expired);
+
+  // Return the waiting time until the next tick, or -1 if the wheel is empty.
+  int NextTickMs(int64_t now_ms) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+private:
+  void Link(TimeoutNode* node);
+
+private:
+  uint32_t tick_ms_;
+
+  // The last advanced tick. -1 means not started.
+  int64_t current_tick_;
+
+  // Every slot is a circular list with a sentinel node.
+  std::vector<TimeoutNode> slots_;
+
+  size_t size_;
+};
+
+}  // namespace epoll_server
+
+#endif  // EPOLL_SERVER_TIMEOUT_WHEEL_H_
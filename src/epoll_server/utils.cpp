@@ -4,6 +4,8 @@
 
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include <sys/fcntl.h>
@@ -76,6 +78,22 @@ bool SetReusePort(int fd) {
   return true;
 }
 
+bool SetIntOption(int fd, int level, int option, int value) {
+  return setsockopt(fd, level, option, (const void*)&value, sizeof(value)) == 0;
+}
+
+std::string IpToString(uint32_t addr) {
+  struct in_addr in_addr;
+  in_addr.s_addr = addr;
+
+  char ip[INET_ADDRSTRLEN] = { 0 };
+  if (inet_ntop(AF_INET, &in_addr, ip, sizeof(ip)) == nullptr) {
+    return "";
+  }
+
+  return ip;
+}
+
 int Recv(int fd, char* buf, size_t buf_len) {
   ssize_t n = recv(fd, buf, buf_len, 0);
 
@@ -126,6 +144,62 @@ int Send(int fd, const char* buf, size_t buf_len, size_t* sended_size) {
   return 1;
 }
 
+ssize_t Sendv(int fd, const struct iovec* iov, size_t iov_count, bool more) {
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec*>(iov);
+  msg.msg_iovlen = iov_count;
+
+  for (;;) {
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    if (n >= 0) {
+      return n;
+    }
+
+    int err = errno;
+    if (err == EINTR) {
+      continue;
+    }
+
+    // System write buffer is full. It should wait the writable event.
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return 0;
+    }
+
+    SPDLOG_WARN("Send error: {}:{}.", err, strerror(err));
+    return -1;
+  }
+}
+
+ssize_t SendFile(int fd, int file_fd, uint64_t offset, size_t count) {
+  off_t file_offset = static_cast<off_t>(offset);
+  for (;;) {
+    ssize_t n = sendfile(fd, file_fd, &file_offset, count);
+    if (n > 0) {
+      return n;
+    }
+
+    // The file is truncated after the range is opened.
+    if (n == 0) {
+      SPDLOG_WARN("Sendfile error: unexpected end of file.");
+      return -1;
+    }
+
+    int err = errno;
+    if (err == EINTR) {
+      continue;
+    }
+
+    // System write buffer is full. It should wait the writable event.
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return 0;
+    }
+
+    SPDLOG_WARN("Sendfile error: {}:{}.", err, strerror(err));
+    return -1;
+  }
+}
+
 }  // namespace sock
 
 inline uint16_t CharToUint16(char c) {
@@ -156,6 +230,17 @@ uint32_t BytesToUint32(ByteOrder byte_order, const char bytes[4]) {
 
 std::string Uint32ToBytes(ByteOrder byte_order, uint32_t num) {
   std::string bytes(4, 0);
+  Uint32ToBytes(byte_order, num, &bytes[0]);
+  return bytes;
+}
+
+std::string Uint16ToBytes(ByteOrder byte_order, uint16_t num) {
+  std::string bytes(2, 0);
+  Uint16ToBytes(byte_order, num, &bytes[0]);
+  return bytes;
+}
+
+void Uint32ToBytes(ByteOrder byte_order, uint32_t num, char bytes[4]) {
   if (byte_order == kLittleEndian) {
     bytes[0] = static_cast<uint8_t>(num);
     bytes[1] = static_cast<uint8_t>(num >> 8);
@@ -167,12 +252,9 @@ std::string Uint32ToBytes(ByteOrder byte_order, uint32_t num) {
     bytes[1] = static_cast<uint8_t>(num >> 16);
     bytes[0] = static_cast<uint8_t>(num >> 24);
   }
-
-  return bytes;
 }
 
-std::string Uint16ToBytes(ByteOrder byte_order, uint16_t num) {
-  std::string bytes(2, 0);
+void Uint16ToBytes(ByteOrder byte_order, uint16_t num, char bytes[2]) {
   if (byte_order == kLittleEndian) {
     bytes[0] = static_cast<uint8_t>(num);
     bytes[1] = static_cast<uint8_t>(num >> 8);
@@ -180,8 +262,6 @@ std::string Uint16ToBytes(ByteOrder byte_order, uint16_t num) {
     bytes[1] = static_cast<uint8_t>(num);
     bytes[0] = static_cast<uint8_t>(num >> 8);
   }
-
-  return bytes;
 }
 
 int64_t GetNowTimestamp() {
@@ -190,4 +270,10 @@ int64_t GetNowTimestamp() {
   return duration_cast<milliseconds>(now).count();
 }
 
+int64_t GetSteadyMicroseconds() {
+  using namespace std::chrono;
+  auto now = steady_clock::now().time_since_epoch();
+  return duration_cast<microseconds>(now).count();
+}
+
 }  // namespace epoll_server
@@ -3,6 +3,9 @@
 
 #include <cstdint>
 #include <string>
+#include <sys/types.h>
+
+struct iovec;
 
 namespace epoll_server {
 
@@ -17,6 +20,12 @@ bool Bind(int fd, unsigned short port);
 bool SetReuseAddr(int fd);
 bool SetReusePort(int fd);
 
+// setsockopt with an int value.
+bool SetIntOption(int fd, int level, int option, int value);
+
+// Format the IPV4 address in network byte order to dotted-decimal string.
+std::string IpToString(uint32_t addr);
+
 // Return > 0: Receiving data count.
 // Return = 0: EAGAIN or EWOULDBLOCK or EINTR.
 // Return = -1: Error.
@@ -27,6 +36,19 @@ int Recv(int fd, char* buf, size_t buf_len);
 // Return = -1: Error.
 int Send(int fd, const char* buf, size_t buf_len, size_t* sended_size);
 
+// Gather write the buffers with one sendmsg call. SIGPIPE is not raised if the peer closed.
+// Return > 0: Sended data count. The buffers may be sended partly.
+// Return = 0: EAGAIN or EWOULDBLOCK.
+// Return = -1: Error.
+// more: More data is sended soon, so the kernel can merge them into full segments.
+ssize_t Sendv(int fd, const struct iovec* iov, size_t iov_count, bool more = false);
+
+// Send count bytes of the file from offset by sendfile without copy to user space.
+// Return > 0: Sended data count. The file may be sended partly.
+// Return = 0: EAGAIN or EWOULDBLOCK.
+// Return = -1: Error, or the file is shorter than the range.
+ssize_t SendFile(int fd, int file_fd, uint64_t offset, size_t count);
+
 }  // namespace sock
 
 enum ByteOrder {
@@ -40,9 +62,16 @@ uint16_t BytesToUint16(ByteOrder byte_order, const char bytes[2]);
 std::string Uint32ToBytes(ByteOrder byte_order, uint32_t num);
 std::string Uint16ToBytes(ByteOrder byte_order, uint16_t num);
 
+// Write the bytes into the caller's memory without allocation.
+void Uint32ToBytes(ByteOrder byte_order, uint32_t num, char bytes[4]);
+void Uint16ToBytes(ByteOrder byte_order, uint16_t num, char bytes[2]);
+
 // Return the milliseconds timestamp.
 int64_t GetNowTimestamp();
 
+// Return the microseconds of the monotonic clock. It's used to measure durations.
+int64_t GetSteadyMicroseconds();
+
 }  // namespace epoll_server
 
 #endif  // EPOLL_SERVER_UTILS_H_
@@ -0,0 +1,88 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/codel.h"
+
+using namespace epoll_server;
+
+static const int64_t kTargetUs = 5000;
+static const int64_t kIntervalUs = 100000;
+
+TEST(CodelTest, DisabledByZeroTarget) {
+  Codel codel(0, kIntervalUs);
+  for (int64_t now_us = 0; now_us < 10 * kIntervalUs; now_us += 1000) {
+    EXPECT_FALSE(codel.Overloaded(1000000, now_us));
+  }
+}
+
+TEST(CodelTest, StandingQueue) {
+  Codel codel(kTargetUs, kIntervalUs);
+
+  // The first interval is never judged as overloaded.
+  EXPECT_FALSE(codel.Overloaded(20000, 1000));
+  EXPECT_FALSE(codel.Overloaded(20000, 50000));
+
+  // Even the shortest delay of the last interval is longer than the target. Only the requests
+  // queued longer than twice the target are shed.
+  EXPECT_TRUE(codel.Overloaded(20000, 101000));
+  EXPECT_FALSE(codel.Overloaded(2 * kTargetUs, 102000));
+  EXPECT_TRUE(codel.Overloaded(2 * kTargetUs + 1, 103000));
+}
+
+TEST(CodelTest, ShortBurst) {
+  Codel codel(kTargetUs, kIntervalUs);
+
+  // Some requests in the interval are queued shortly, so it's a burst.
+  EXPECT_FALSE(codel.Overloaded(50000, 1000));
+  EXPECT_FALSE(codel.Overloaded(1000, 2000));
+  EXPECT_FALSE(codel.Overloaded(50000, 3000));
+
+  EXPECT_FALSE(codel.Overloaded(50000, 101000));
+}
+
+TEST(CodelTest, Recover) {
+  Codel codel(kTargetUs, kIntervalUs);
+  codel.Overloaded(20000, 1000);
+  EXPECT_TRUE(codel.Overloaded(20000, 101000));
+
+  // A short delay in the overloaded interval ends the overload at the next interval.
+  EXPECT_TRUE(codel.Overloaded(20000, 150000));
+  EXPECT_FALSE(codel.Overloaded(1000, 160000));
+  EXPECT_FALSE(codel.Overloaded(20000, 201000));
+}
+
+TEST(CodelTest, ConcurrentWorkers) {
+  Codel codel(kTargetUs, kIntervalUs);
+
+  // All the workers see a standing queue, so the long delays are shed after the first interval.
+  // A worker may miss the judgement of another worker rolling the interval over at the same
+  // time, so only most of them are expected to be shed.
+  const int kWorkers = 4;
+  const int64_t kRequests = 100000;
+  std::atomic<int64_t> eligible(0);
+  std::atomic<int64_t> shed(0);
+  std::vector<std::thread> workers;
+  for (int w = 0; w < kWorkers; ++w) {
+    workers.emplace_back([&codel, &eligible, &shed]() {
+      for (int64_t i = 0; i < kRequests; ++i) {
+        int64_t now_us = i * 10;
+        bool overloaded = codel.Overloaded(50000, now_us);
+        if (now_us >= 2 * kIntervalUs) {
+          ++eligible;
+          if (overloaded) {
+            ++shed;
+          }
+        }
+      }
+    });
+  }
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  EXPECT_GT(shed.load(), eligible.load() * 9 / 10);
+}
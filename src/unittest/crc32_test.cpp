@@ -0,0 +1,58 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/crc32.h"
+
+using namespace epoll_server;
+
+static std::string MakeRandom(size_t size) {
+  std::string data(size, '\0');
+  unsigned int seed = 2020;
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<char>(seed >> 16);
+  }
+
+  return data;
+}
+
+TEST(Crc32Test, CheckValue) {
+  EXPECT_EQ(0xCBF43926u, CalcCRC32(std::string("123456789")));
+  EXPECT_EQ(0u, CalcCRC32(std::string()));
+}
+
+TEST(Crc32Test, KernelsAgree) {
+  EXPECT_TRUE(IsCrc32KernelSupported(kCrc32Bytewise));
+  EXPECT_TRUE(IsCrc32KernelSupported(GetCrc32Kernel()));
+
+  // All the lengths around the 8, 16 and 64 bytes blocks, at unaligned offsets.
+  std::string data = MakeRandom(4096 + 16);
+  for (int k = 0; k < kCrc32KernelCount; ++k) {
+    Crc32Kernel kernel = static_cast<Crc32Kernel>(k);
+    if (!IsCrc32KernelSupported(kernel)) {
+      continue;
+    }
+
+    for (size_t offset = 0; offset < 16; offset += 3) {
+      for (size_t size = 0; size <= 300; ++size) {
+        ASSERT_EQ(CalcCRC32(kCrc32Bytewise, data.data() + offset, size),
+                  CalcCRC32(kernel, data.data() + offset, size))
+            << GetCrc32KernelName(kernel) << " offset: " << offset << " size: " << size;
+      }
+    }
+
+    EXPECT_EQ(CalcCRC32(kCrc32Bytewise, data.data(), 4096), CalcCRC32(kernel, data.data(), 4096))
+        << GetCrc32KernelName(kernel);
+  }
+}
+
+TEST(Crc32Test, Extend) {
+  std::string data = MakeRandom(1000);
+  unsigned int crc = CalcCRC32(data);
+  for (size_t split = 0; split <= data.size(); split += 37) {
+    EXPECT_EQ(crc, ExtendCRC32(CalcCRC32(data.data(), split), data.data() + split,
+                               data.size() - split))
+        << split;
+  }
+}
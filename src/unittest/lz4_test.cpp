@@ -0,0 +1,97 @@
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/lz4.h"
+
+using namespace epoll_server;
+
+// Compress and decompress the data. Return false if failed or the data is changed.
+static bool RoundTrip(const std::string& data) {
+  std::vector<char> compressed(lz4::CompressBound(data.size()));
+  size_t compressed_size = lz4::Compress(data.data(), data.size(), compressed.data(),
+                                         compressed.size());
+  if (compressed_size == 0 && !data.empty()) {
+    return false;
+  }
+
+  std::string decompressed(data.size(), '\0');
+  return lz4::Decompress(compressed.data(), compressed_size, &decompressed[0],
+                         decompressed.size()) &&
+         decompressed == data;
+}
+
+static std::string MakeRandom(size_t size, unsigned int seed) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = static_cast<char>(seed >> 16);
+  }
+
+  return data;
+}
+
+TEST(Lz4Test, RoundTripCompressible) {
+  std::string json;
+  for (int i = 0; i < 1000; ++i) {
+    json += "{\"name\":\"Hello\",\"value\":" + std::to_string(i) + "},";
+  }
+
+  EXPECT_TRUE(RoundTrip(json));
+  EXPECT_TRUE(RoundTrip(std::string(100000, 'a')));
+
+  std::vector<char> compressed(lz4::CompressBound(json.size()));
+  size_t compressed_size = lz4::Compress(json.data(), json.size(), compressed.data(),
+                                         compressed.size());
+  EXPECT_GT(compressed_size, 0u);
+  EXPECT_LT(compressed_size, json.size() / 2);
+}
+
+TEST(Lz4Test, RoundTripSizes) {
+  // Around the minimum match and the last literals limits.
+  for (size_t size = 1; size < 100; ++size) {
+    EXPECT_TRUE(RoundTrip(std::string(size, 'x'))) << size;
+    EXPECT_TRUE(RoundTrip(MakeRandom(size, static_cast<unsigned int>(size)))) << size;
+  }
+
+  EXPECT_TRUE(RoundTrip(MakeRandom(70000, 2020)));
+}
+
+TEST(Lz4Test, CapacityNotEnough) {
+  std::string data = MakeRandom(1000, 2020);
+  std::vector<char> compressed(data.size() / 2);
+  EXPECT_EQ(0u, lz4::Compress(data.data(), data.size(), compressed.data(), compressed.size()));
+}
+
+TEST(Lz4Test, DecompressStandardBlock) {
+  // One literal 'a' and a match of 10 bytes at offset 1, then 5 last literals.
+  const char block[] = "\x16" "a" "\x01\x00" "\x50" "bbbbb";
+  std::string decompressed(16, '\0');
+  ASSERT_TRUE(lz4::Decompress(block, sizeof(block) - 1, &decompressed[0], decompressed.size()));
+  EXPECT_EQ("aaaaaaaaaaabbbbb", decompressed);
+}
+
+TEST(Lz4Test, DecompressMalformed) {
+  std::string decompressed(16, '\0');
+
+  // The offset is 0.
+  const char zero_offset[] = "\x16" "a" "\x00\x00" "\x50" "bbbbb";
+  EXPECT_FALSE(lz4::Decompress(zero_offset, sizeof(zero_offset) - 1, &decompressed[0],
+                               decompressed.size()));
+
+  // The offset is before the output.
+  const char far_offset[] = "\x16" "a" "\x02\x00" "\x50" "bbbbb";
+  EXPECT_FALSE(lz4::Decompress(far_offset, sizeof(far_offset) - 1, &decompressed[0],
+                               decompressed.size()));
+
+  // The literals are truncated.
+  const char truncated[] = "\x16" "a" "\x01\x00" "\x50" "bb";
+  EXPECT_FALSE(lz4::Decompress(truncated, sizeof(truncated) - 1, &decompressed[0],
+                               decompressed.size()));
+
+  // The output is longer than expected.
+  const char block[] = "\x16" "a" "\x01\x00" "\x50" "bbbbb";
+  EXPECT_FALSE(lz4::Decompress(block, sizeof(block) - 1, &decompressed[0], 10));
+}
@@ -0,0 +1,126 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/mpsc_queue.h"
+
+using namespace epoll_server;
+
+namespace {
+
+std::atomic<int> g_alive(0);
+
+class Node : public MpscNode<Node> {
+public:
+  Node(int producer_, int value_) : producer(producer_), value(value_), refs_(0) {
+    ++g_alive;
+  }
+
+  ~Node() {
+    --g_alive;
+  }
+
+  void Ref() {
+    refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void Unref() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  int producer;
+  int value;
+
+private:
+  std::atomic<int> refs_;
+};
+
+using NodePtr = IntrusivePtr<Node>;
+
+}  // namespace
+
+TEST(MpscQueueTest, PopInPushOrder) {
+  MpscQueue<Node> queue;
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_TRUE(queue.Pop() == nullptr);
+
+  for (int i = 0; i < 100; ++i) {
+    queue.Push(NodePtr(new Node(0, i)));
+  }
+  EXPECT_FALSE(queue.Empty());
+
+  for (int i = 0; i < 100; ++i) {
+    NodePtr node = queue.Pop();
+    ASSERT_TRUE(node != nullptr);
+    EXPECT_EQ(i, node->value);
+  }
+
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_TRUE(queue.Pop() == nullptr);
+
+  // The queue is reusable after the stub is pushed back.
+  queue.Push(NodePtr(new Node(0, 100)));
+  NodePtr node = queue.Pop();
+  ASSERT_TRUE(node != nullptr);
+  EXPECT_EQ(100, node->value);
+}
+
+TEST(MpscQueueTest, IgnoreNull) {
+  MpscQueue<Node> queue;
+  queue.Push(NodePtr());
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(MpscQueueTest, ReleaseLeftNodes) {
+  {
+    MpscQueue<Node> queue;
+    for (int i = 0; i < 10; ++i) {
+      queue.Push(NodePtr(new Node(0, i)));
+    }
+    EXPECT_EQ(10, g_alive.load());
+  }
+
+  EXPECT_EQ(0, g_alive.load());
+}
+
+TEST(MpscQueueTest, ManyProducers) {
+  const int kProducers = 4;
+  const int kCount = 20000;
+
+  MpscQueue<Node> queue;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&queue, p]() {
+      for (int i = 0; i < kCount; ++i) {
+        queue.Push(NodePtr(new Node(p, i)));
+      }
+    });
+  }
+
+  // Pop() may return nullptr while a push is not finished, so poll until all are popped.
+  std::vector<int> next(kProducers, 0);
+  int popped = 0;
+  while (popped < kProducers * kCount) {
+    NodePtr node = queue.Pop();
+    if (!node) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // The nodes of a producer are in its pushing order.
+    EXPECT_EQ(next[node->producer], node->value);
+    ++next[node->producer];
+    ++popped;
+  }
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+
+  EXPECT_TRUE(queue.Empty());
+  EXPECT_EQ(0, g_alive.load());
+}
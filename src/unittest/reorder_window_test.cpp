@@ -0,0 +1,150 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/connection.h"
+#include "epoll_server/connection_pool.h"
+#include "epoll_server/connection_table.h"
+#include "epoll_server/message.h"
+#include "epoll_server/utils.h"
+
+using namespace epoll_server;
+
+// The responses of an ordered connection are sended in the order of the requests, whatever
+// order they are appended in. The connection writes to a socket pair.
+class ReorderWindowTest : public testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds_));
+
+    ConnectionTable::GetInstance()->Init(1);
+    ASSERT_TRUE(pool_.Init(1));
+    conn_ = pool_.Get();
+    conn_->set_fd(fds_[0]);
+    conn_->set_ordered(true);
+  }
+
+  void TearDown() override {
+    // The connection closes its fd.
+    pool_.Release(conn_);
+    close(fds_[1]);
+  }
+
+  MessagePtr AddRequest() {
+    MessagePtr request = Message::Create();
+    request->set_conn_handle(conn_->handle());
+    conn_->AddInflightRequest(request.get());
+    return request;
+  }
+
+  static MessagePtr MakeResponse(const MessagePtr& request, const std::string& data) {
+    MessagePtr response = Message::Create(request->conn_handle(), 2020, std::string(data));
+    response->ReplyTo(*request);
+    return response;
+  }
+
+  // Send the outbound queue and return the data of the v1 responses received by the peer.
+  std::vector<std::string> Receive() {
+    std::vector<std::string> responses;
+    if (!conn_->HasSendData()) {
+      return responses;
+    }
+
+    EXPECT_TRUE(conn_->HandleWrite());
+    EXPECT_FALSE(conn_->HasSendData());
+
+    char buf[4096];
+    ssize_t n = read(fds_[1], buf, sizeof(buf));
+    EXPECT_GT(n, 0);
+
+    for (ssize_t offset = 0; offset + Message::kHeaderLen <= n;) {
+      uint16_t len = BytesToUint16(kLittleEndian, &buf[offset]);
+      offset += Message::kHeaderLen;
+      responses.push_back(std::string(&buf[offset], len));
+      offset += len;
+    }
+
+    return responses;
+  }
+
+  int fds_[2];
+  ConnectionPool pool_;
+  Connection* conn_;
+};
+
+TEST_F(ReorderWindowTest, SendInRequestOrder) {
+  MessagePtr first = AddRequest();
+  MessagePtr second = AddRequest();
+  MessagePtr third = AddRequest();
+  EXPECT_EQ(3u, conn_->InflightRequests());
+
+  // Wait for the response of the first request.
+  conn_->AppendResponse(MakeResponse(third, "3"));
+  conn_->AppendResponse(MakeResponse(second, "2"));
+  EXPECT_FALSE(conn_->HasSendData());
+  EXPECT_EQ(3u, conn_->InflightRequests());
+
+  conn_->AppendResponse(MakeResponse(first, "1"));
+  EXPECT_EQ(0u, conn_->InflightRequests());
+  EXPECT_EQ(std::vector<std::string>({"1", "2", "3"}), Receive());
+}
+
+TEST_F(ReorderWindowTest, SkipPlaceholder) {
+  MessagePtr first = AddRequest();
+  MessagePtr second = AddRequest();
+  MessagePtr third = AddRequest();
+
+  MessagePtr placeholder = MakeResponse(second, std::string());
+  placeholder->set_placeholder(true);
+
+  conn_->AppendResponse(MakeResponse(third, "3"));
+  conn_->AppendResponse(std::move(placeholder));
+  conn_->AppendResponse(MakeResponse(first, "1"));
+  EXPECT_EQ(0u, conn_->InflightRequests());
+  EXPECT_EQ(std::vector<std::string>({"1", "3"}), Receive());
+}
+
+TEST_F(ReorderWindowTest, StreamingResponses) {
+  MessagePtr first = AddRequest();
+  MessagePtr second = AddRequest();
+
+  MessagePtr first_a = MakeResponse(first, "1a");
+  first_a->set_has_more(true);
+  MessagePtr first_b = MakeResponse(first, "1b");
+  first_b->set_has_more(true);
+
+  // The streaming responses of the first request are sended as they arrive, and the second
+  // waits until the last one.
+  conn_->AppendResponse(MakeResponse(second, "2"));
+  conn_->AppendResponse(std::move(first_a));
+  EXPECT_EQ(std::vector<std::string>({"1a"}), Receive());
+
+  conn_->AppendResponse(std::move(first_b));
+  conn_->AppendResponse(MakeResponse(first, "1c"));
+  EXPECT_EQ(0u, conn_->InflightRequests());
+  EXPECT_EQ(std::vector<std::string>({"1b", "1c", "2"}), Receive());
+}
+
+TEST_F(ReorderWindowTest, StreamingInWindow) {
+  MessagePtr first = AddRequest();
+  MessagePtr second = AddRequest();
+  MessagePtr third = AddRequest();
+
+  // The second request streams while waiting in the window. Its last response is not arrived
+  // when the window moves on, so the third keeps waiting.
+  MessagePtr second_a = MakeResponse(second, "2a");
+  second_a->set_has_more(true);
+  conn_->AppendResponse(std::move(second_a));
+  conn_->AppendResponse(MakeResponse(third, "3"));
+  conn_->AppendResponse(MakeResponse(first, "1"));
+  EXPECT_EQ(2u, conn_->InflightRequests());
+  EXPECT_EQ(std::vector<std::string>({"1", "2a"}), Receive());
+
+  conn_->AppendResponse(MakeResponse(second, "2b"));
+  EXPECT_EQ(0u, conn_->InflightRequests());
+  EXPECT_EQ(std::vector<std::string>({"2b", "3"}), Receive());
+}
@@ -0,0 +1,99 @@
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/thread_safe_queue.h"
+
+using namespace epoll_server;
+
+TEST(ThreadSafeQueueTest, PopInPushOrder) {
+  ThreadSafeQueue<int> queue;
+  for (int i = 0; i < 10; ++i) {
+    queue.Push(int(i));
+  }
+
+  EXPECT_EQ(10u, queue.Size());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i, queue.PopOrWait());
+  }
+  EXPECT_EQ(0u, queue.Size());
+}
+
+TEST(ThreadSafeQueueTest, GrowWrappedRing) {
+  ThreadSafeQueue<int> queue;
+
+  // Move the head to the middle of the ring, so the elements wrap around when it grows.
+  int pushed = 0;
+  int popped = 0;
+  for (; pushed < 40; ++pushed) {
+    queue.Push(int(pushed));
+  }
+  for (; popped < 30; ++popped) {
+    EXPECT_EQ(popped, queue.PopOrWait());
+  }
+
+  for (; pushed < 1000; ++pushed) {
+    queue.Push(int(pushed));
+  }
+
+  EXPECT_EQ(970u, queue.Size());
+  for (; popped < 1000; ++popped) {
+    EXPECT_EQ(popped, queue.PopOrWait());
+  }
+}
+
+TEST(ThreadSafeQueueTest, TryPushCapacity) {
+  ThreadSafeQueue<int> queue;
+  EXPECT_TRUE(queue.TryPush(1, 2));
+  EXPECT_TRUE(queue.TryPush(2, 2));
+  EXPECT_FALSE(queue.TryPush(3, 2));
+  EXPECT_EQ(2u, queue.Size());
+
+  // 0 means unbounded.
+  EXPECT_TRUE(queue.TryPush(3, 0));
+  EXPECT_EQ(3u, queue.Size());
+}
+
+TEST(ThreadSafeQueueTest, KeepRejectedElement) {
+  ThreadSafeQueue<std::unique_ptr<int>> queue;
+  ASSERT_TRUE(queue.TryPush(std::unique_ptr<int>(new int(1)), 1));
+
+  // The element is only moved if it's pushed.
+  std::unique_ptr<int> rejected(new int(2));
+  EXPECT_FALSE(queue.TryPush(std::move(rejected), 1));
+  ASSERT_TRUE(rejected != nullptr);
+  EXPECT_EQ(2, *rejected);
+}
+
+TEST(ThreadSafeQueueTest, ClearReleasesElements) {
+  std::shared_ptr<int> element = std::make_shared<int>(1);
+  ThreadSafeQueue<std::shared_ptr<int>> queue;
+  for (int i = 0; i < 100; ++i) {
+    queue.Push(std::shared_ptr<int>(element));
+  }
+
+  queue.Clear();
+  EXPECT_EQ(0u, queue.Size());
+  EXPECT_EQ(1, element.use_count());
+
+  queue.Push(std::make_shared<int>(2));
+  EXPECT_EQ(2, *queue.PopOrWait());
+}
+
+TEST(ThreadSafeQueueTest, PopOrWaitAcrossThreads) {
+  const int kCount = 100000;
+
+  ThreadSafeQueue<int> queue;
+  std::thread producer([&queue]() {
+    for (int i = 0; i < kCount; ++i) {
+      queue.Push(int(i));
+    }
+  });
+
+  for (int i = 0; i < kCount; ++i) {
+    ASSERT_EQ(i, queue.PopOrWait());
+  }
+
+  producer.join();
+}
@@ -0,0 +1,118 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/timeout_wheel.h"
+
+using namespace epoll_server;
+
+TEST(TimeoutWheelTest, ExpireAtTickNotEarlier) {
+  TimeoutWheel wheel(8, 100);
+  std::vector<TimeoutNode*> expired;
+  wheel.Advance(0, &expired);
+
+  TimeoutNode node;
+  wheel.Schedule(&node, 250);
+  EXPECT_EQ(1u, wheel.size());
+  EXPECT_TRUE(node.linked);
+
+  // Rounded up to the tick of 300 ms.
+  wheel.Advance(299, &expired);
+  EXPECT_TRUE(expired.empty());
+
+  wheel.Advance(300, &expired);
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(&node, expired[0]);
+  EXPECT_FALSE(node.linked);
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimeoutWheelTest, CancelAndReschedule) {
+  TimeoutWheel wheel(8, 100);
+  std::vector<TimeoutNode*> expired;
+  wheel.Advance(0, &expired);
+
+  TimeoutNode canceled;
+  TimeoutNode rescheduled;
+  wheel.Schedule(&canceled, 200);
+  wheel.Schedule(&rescheduled, 200);
+  wheel.Cancel(&canceled);
+
+  // Cancel a canceled timeout does nothing.
+  wheel.Cancel(&canceled);
+  wheel.Schedule(&rescheduled, 500);
+  EXPECT_EQ(1u, wheel.size());
+
+  wheel.Advance(400, &expired);
+  EXPECT_TRUE(expired.empty());
+
+  wheel.Advance(500, &expired);
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(&rescheduled, expired[0]);
+}
+
+TEST(TimeoutWheelTest, LongerThanWheel) {
+  TimeoutWheel wheel(8, 100);
+  std::vector<TimeoutNode*> expired;
+  wheel.Advance(0, &expired);
+
+  // Two rounds and one slot later. The slot is visited twice before the timeout expires.
+  TimeoutNode node;
+  wheel.Schedule(&node, 1700);
+  for (int64_t now_ms = 100; now_ms < 1700; now_ms += 100) {
+    wheel.Advance(now_ms, &expired);
+    ASSERT_TRUE(expired.empty()) << now_ms;
+  }
+
+  wheel.Advance(1700, &expired);
+  ASSERT_EQ(1u, expired.size());
+  EXPECT_EQ(&node, expired[0]);
+}
+
+TEST(TimeoutWheelTest, AdvanceAfterLongBlocking) {
+  TimeoutWheel wheel(8, 100);
+  std::vector<TimeoutNode*> expired;
+  wheel.Advance(0, &expired);
+
+  std::vector<TimeoutNode> nodes(20);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    wheel.Schedule(&nodes[i], 100 * (i + 1));
+  }
+
+  // Every slot is visited once, and all the timeouts before now expire.
+  wheel.Advance(1500, &expired);
+  EXPECT_EQ(15u, expired.size());
+  EXPECT_EQ(5u, wheel.size());
+
+  expired.clear();
+  wheel.Advance(10000, &expired);
+  EXPECT_EQ(5u, expired.size());
+  EXPECT_EQ(0u, wheel.size());
+}
+
+TEST(TimeoutWheelTest, ScheduleExpiredToNextTick) {
+  TimeoutWheel wheel(8, 100);
+  std::vector<TimeoutNode*> expired;
+  wheel.Advance(1000, &expired);
+
+  TimeoutNode node;
+  wheel.Schedule(&node, 500);
+  wheel.Advance(1099, &expired);
+  EXPECT_TRUE(expired.empty());
+
+  wheel.Advance(1100, &expired);
+  EXPECT_EQ(1u, expired.size());
+}
+
+TEST(TimeoutWheelTest, NextTickMs) {
+  TimeoutWheel wheel(8, 100);
+  EXPECT_EQ(-1, wheel.NextTickMs(1030));
+
+  TimeoutNode node;
+  wheel.Schedule(&node, 5000);
+  EXPECT_EQ(70, wheel.NextTickMs(1030));
+  EXPECT_EQ(100, wheel.NextTickMs(1100));
+
+  wheel.Cancel(&node);
+  EXPECT_EQ(-1, wheel.NextTickMs(1030));
+}
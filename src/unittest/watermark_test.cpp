@@ -0,0 +1,166 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "epoll_server/config.h"
+#include "epoll_server/connection.h"
+#include "epoll_server/connection_table.h"
+#include "epoll_server/event_loop.h"
+#include "epoll_server/message.h"
+
+using namespace epoll_server;
+
+// The event loop pauses reading a connection above the high watermarks and resumes below the low
+// watermarks. The test drives the loop by PollOnce() with a client connected to its acceptor.
+class WatermarkTest : public testing::Test {
+protected:
+  void SetUp() override {
+    // The idle timeout wakes up the loop every tick, so PollOnce() doesn't block long.
+    CONFIG.idle_timeout_ms = 60000;
+    CONFIG.inflight_high_watermark = 0;
+    CONFIG.inflight_low_watermark = 0;
+    CONFIG.send_high_watermark = 0;
+    CONFIG.send_low_watermark = 0;
+
+    acceptor_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ASSERT_NE(-1, acceptor_fd_);
+
+    // The accepted socket inherits the small send buffer, so the responses are queued soon.
+    int buf_size = 4096;
+    ASSERT_EQ(0, setsockopt(acceptor_fd_, SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size)));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(0, bind(acceptor_fd_, reinterpret_cast<struct sockaddr*>(&addr), addr_len));
+    ASSERT_EQ(0, listen(acceptor_fd_, 8));
+    ASSERT_EQ(0, getsockname(acceptor_fd_, reinterpret_cast<struct sockaddr*>(&addr), &addr_len));
+
+    ConnectionTable::GetInstance()->Init(4);
+    ASSERT_TRUE(loop_.Init(acceptor_fd_, 4));
+    loop_.set_request_handler([this](MessagePtr request) {
+      requests_.push_back(std::move(request));
+    });
+    loop_.set_on_connected([this](Connection* conn) {
+      conn_ = conn;
+    });
+
+    client_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_NE(-1, client_fd_);
+    ASSERT_EQ(0, setsockopt(client_fd_, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size)));
+    ASSERT_EQ(0, connect(client_fd_, reinterpret_cast<struct sockaddr*>(&addr), addr_len));
+
+    ASSERT_TRUE(PollUntil([this]() { return conn_ != nullptr; }));
+  }
+
+  void TearDown() override {
+    // The loop closes the acceptor.
+    close(client_fd_);
+  }
+
+  // Run the loop until the condition is met. Each round receives the responses available.
+  bool PollUntil(const std::function<bool()>& cond, bool receive = false) {
+    for (int i = 0; i < 200 && !cond(); ++i) {
+      if (receive) {
+        Receive();
+      }
+
+      loop_.PollOnce();
+    }
+
+    return cond();
+  }
+
+  void WriteRequests(size_t count) {
+    MessagePtr request = Message::Create(conn_->handle(), 2020, std::string("Hello"));
+    char header[Message::kHeaderLen];
+    request->PackHeader(header);
+
+    std::string bytes;
+    for (size_t i = 0; i < count; ++i) {
+      bytes.append(header, sizeof(header));
+      bytes += request->data;
+    }
+
+    ASSERT_EQ(static_cast<ssize_t>(bytes.size()), write(client_fd_, bytes.data(), bytes.size()));
+  }
+
+  void Respond(size_t index, const std::string& data) {
+    const MessagePtr& request = requests_[index];
+    MessagePtr response = Message::Create(request->conn_handle(), request->code, std::string(data));
+    response->ReplyTo(*request);
+    loop_.AddResponse(std::move(response));
+  }
+
+  void Receive() {
+    char buf[65536];
+    while (recv(client_fd_, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+  }
+
+  int acceptor_fd_ = -1;
+  int client_fd_ = -1;
+  EventLoop loop_;
+  Connection* conn_ = nullptr;
+  std::vector<MessagePtr> requests_;
+};
+
+TEST_F(WatermarkTest, InflightRequests) {
+  CONFIG.inflight_high_watermark = 4;
+  CONFIG.inflight_low_watermark = 1;
+
+  WriteRequests(10);
+  ASSERT_TRUE(PollUntil([this]() { return requests_.size() >= 4; }));
+  loop_.PollOnce();
+  EXPECT_EQ(4u, requests_.size());
+  EXPECT_FALSE(conn_->reading());
+
+  // Still above the low watermark.
+  Respond(0, "Ayou");
+  Respond(1, "Ayou");
+  ASSERT_TRUE(PollUntil([this]() { return conn_->InflightRequests() == 2; }));
+  loop_.PollOnce();
+  EXPECT_EQ(4u, requests_.size());
+  EXPECT_FALSE(conn_->reading());
+
+  // The reading resumes until the high watermark is reached again.
+  Respond(2, "Ayou");
+  ASSERT_TRUE(PollUntil([this]() { return requests_.size() >= 7; }));
+  loop_.PollOnce();
+  EXPECT_EQ(7u, requests_.size());
+  EXPECT_FALSE(conn_->reading());
+}
+
+TEST_F(WatermarkTest, OutboundBytes) {
+  CONFIG.send_high_watermark = 64 * 1024;
+  CONFIG.send_low_watermark = 16 * 1024;
+
+  WriteRequests(4);
+  ASSERT_TRUE(PollUntil([this]() { return requests_.size() >= 4; }));
+
+  // The client doesn't receive the responses, so they are left in the outbound queue.
+  for (size_t i = 0; i < 4; ++i) {
+    Respond(i, std::string(60000, 'a'));
+  }
+
+  ASSERT_TRUE(PollUntil([this]() { return !conn_->reading(); }));
+  EXPECT_GE(conn_->send_bytes(), CONFIG.send_high_watermark);
+
+  WriteRequests(2);
+  loop_.PollOnce();
+  EXPECT_EQ(4u, requests_.size());
+
+  // The reading resumes when the outbound bytes drop to the low watermark.
+  ASSERT_TRUE(PollUntil([this]() { return conn_->reading(); }, true));
+  EXPECT_LE(conn_->send_bytes(), CONFIG.send_low_watermark);
+  ASSERT_TRUE(PollUntil([this]() { return requests_.size() >= 6; }));
+  EXPECT_EQ(6u, requests_.size());
+}
@@ -0,0 +1,39 @@
+package client
+
+import (
+	"net"
+	"testing"
+	"time"
+)
+
+// go  test  test/client -run ^$ -bench . -count=1
+
+// BenchmarkAccept opens a new connection for every request. Run the server with
+// "ioThreadCount": 1 to get the accept rate of one I/O thread (one core).
+func BenchmarkAccept(b *testing.B) {
+	data := NewMessage(2020, []byte("Hi")).Pack()
+
+	start := time.Now()
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			client, err := net.Dial("tcp4", "127.0.0.1:9005")
+			if err != nil {
+				b.Error(err)
+				return
+			}
+
+			if _, err = client.Write(data); err != nil {
+				b.Error(err)
+			}
+
+			rsp := Message{}
+			if err = rsp.Unpack(client); err != nil {
+				b.Error(err)
+			}
+
+			client.Close()
+		}
+	})
+
+	b.ReportMetric(float64(b.N)/time.Since(start).Seconds(), "accepts/s")
+}
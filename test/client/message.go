@@ -69,3 +69,185 @@ func NewMessage(code uint16, data []byte) *Message {
 		Data:    data,
 	}
 }
+
+// The frame of protocol v2.
+type MessageV2 struct {
+	Magic     uint16
+	Version   uint8
+	Flags     uint8
+	Code      uint16
+	Reserved  uint16
+	ChunkLen  uint32
+	RequestId uint64
+	Crc32     uint32
+	Data      []byte
+}
+
+const (
+	V2HeadLen = 24
+	V2Magic   = 0xFFFF
+	FlagMore  = 0x01
+
+	FlagCompressed        = 0x02
+	FlagAcceptCompression = 0x04
+
+	// The reserved code of the empty response instead of a v1 response longer than 65534 bytes.
+	CodeTooLong = 0xFFFE
+)
+
+func (msg MessageV2) String() string {
+	return fmt.Sprintf("Flags: %v, Code: %v, Len: %v, RequestId: %v", msg.Flags, msg.Code, msg.ChunkLen, msg.RequestId)
+}
+
+func (msg *MessageV2) Pack() []byte {
+	dataBuff := bytes.NewBuffer([]byte{})
+
+	binary.Write(dataBuff, binary.LittleEndian, msg.Magic)
+	binary.Write(dataBuff, binary.LittleEndian, msg.Version)
+	binary.Write(dataBuff, binary.LittleEndian, msg.Flags)
+	binary.Write(dataBuff, binary.LittleEndian, msg.Code)
+	binary.Write(dataBuff, binary.LittleEndian, msg.Reserved)
+	binary.Write(dataBuff, binary.LittleEndian, msg.ChunkLen)
+	binary.Write(dataBuff, binary.LittleEndian, msg.RequestId)
+	binary.Write(dataBuff, binary.LittleEndian, msg.Crc32)
+	binary.Write(dataBuff, binary.LittleEndian, msg.Data)
+
+	return dataBuff.Bytes()
+}
+
+func (msg *MessageV2) Unpack(conn io.Reader) error {
+	headData := make([]byte, V2HeadLen)
+	if _, err := io.ReadFull(conn, headData); err != nil {
+		return err
+	}
+
+	buff := bytes.NewReader(headData)
+	binary.Read(buff, binary.LittleEndian, &msg.Magic)
+	binary.Read(buff, binary.LittleEndian, &msg.Version)
+	binary.Read(buff, binary.LittleEndian, &msg.Flags)
+	binary.Read(buff, binary.LittleEndian, &msg.Code)
+	binary.Read(buff, binary.LittleEndian, &msg.Reserved)
+	binary.Read(buff, binary.LittleEndian, &msg.ChunkLen)
+	binary.Read(buff, binary.LittleEndian, &msg.RequestId)
+	binary.Read(buff, binary.LittleEndian, &msg.Crc32)
+
+	if msg.Magic != V2Magic || msg.Version != 2 {
+		return errors.New("Not a v2 frame")
+	}
+
+	msg.Data = make([]byte, msg.ChunkLen)
+	if _, err := io.ReadFull(conn, msg.Data); err != nil {
+		return err
+	}
+
+	crc32 := crc32.ChecksumIEEE(msg.Data)
+	if crc32 != msg.Crc32 {
+		return errors.New("CRC32 check failed")
+	}
+
+	return nil
+}
+
+func NewMessageV2(code uint16, requestId uint64, flags uint8, data []byte) *MessageV2 {
+	return &MessageV2{
+		Magic:     V2Magic,
+		Version:   2,
+		Flags:     flags,
+		Code:      code,
+		ChunkLen:  uint32(len(data)),
+		RequestId: requestId,
+		Crc32:     crc32.ChecksumIEEE(data),
+		Data:      data,
+	}
+}
+
+// Decompress the chunk with FlagCompressed: OriginalLen(4) + LZ4 block.
+func DecompressChunk(chunk []byte) ([]byte, error) {
+	if len(chunk) < 4 {
+		return nil, errors.New("Short compressed chunk")
+	}
+
+	size := binary.LittleEndian.Uint32(chunk)
+	src := chunk[4:]
+	dst := make([]byte, 0, size)
+
+	readLength := func(length int) (int, error) {
+		for {
+			if len(src) == 0 {
+				return 0, errors.New("Truncated length")
+			}
+			b := src[0]
+			src = src[1:]
+			length += int(b)
+			if b != 255 {
+				return length, nil
+			}
+		}
+	}
+
+	for len(src) > 0 {
+		token := src[0]
+		src = src[1:]
+
+		var err error
+		literalLen := int(token >> 4)
+		if literalLen == 15 {
+			if literalLen, err = readLength(literalLen); err != nil {
+				return nil, err
+			}
+		}
+		if literalLen > len(src) {
+			return nil, errors.New("Truncated literals")
+		}
+		dst = append(dst, src[:literalLen]...)
+		src = src[literalLen:]
+
+		if len(src) == 0 {
+			break
+		}
+		if len(src) < 2 {
+			return nil, errors.New("Truncated offset")
+		}
+		offset := int(binary.LittleEndian.Uint16(src))
+		src = src[2:]
+		if offset == 0 || offset > len(dst) {
+			return nil, errors.New("Invalid offset")
+		}
+
+		matchLen := int(token & 15)
+		if matchLen == 15 {
+			if matchLen, err = readLength(matchLen); err != nil {
+				return nil, err
+			}
+		}
+		for i := 0; i < matchLen+4; i++ {
+			dst = append(dst, dst[len(dst)-offset])
+		}
+	}
+
+	if len(dst) != int(size) {
+		return nil, errors.New("Wrong decompressed length")
+	}
+
+	return dst, nil
+}
+
+// Compress the data to a LZ4 block of literals only, which is enough to test the decompression
+// of the server.
+func CompressChunk(data []byte) []byte {
+	chunk := make([]byte, 4)
+	binary.LittleEndian.PutUint32(chunk, uint32(len(data)))
+
+	if len(data) < 15 {
+		chunk = append(chunk, byte(len(data)<<4))
+	} else {
+		chunk = append(chunk, 15<<4)
+		length := len(data) - 15
+		for ; length >= 255; length -= 255 {
+			chunk = append(chunk, 255)
+		}
+		chunk = append(chunk, byte(length))
+	}
+
+	return append(chunk, data...)
+}
@@ -3,7 +3,9 @@ package client
 import (
 	"fmt"
 	"net"
+	"strings"
 	"testing"
+	"time"
 )
 
 // go  test  test/client -run ^TestMessage$ -count=1 -v
@@ -72,3 +74,371 @@ func TestMessage2(t *testing.T) {
 
 	fmt.Println(rsp)
 }
+
+func TestPipelineMessages(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	const count = 100
+	buf := []byte{}
+	for i := 0; i < count; i++ {
+		msg := NewMessage(2020, []byte(fmt.Sprintf("Hello%v", i)))
+		buf = append(buf, msg.Pack()...)
+	}
+
+	if _, err = client.Write(buf); err != nil {
+		t.Fatal(err)
+	}
+
+	for i := 0; i < count; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+	}
+}
+
+// The burst is written at once, so an edge triggered server is not notified again for the
+// messages left after a read budget. Run the server with socket.edgeTriggered to check them.
+func TestReadBudgetBurst(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// Many times of the default socket.readBudget.
+	const count = 1000
+	buf := []byte{}
+	for i := 0; i < count; i++ {
+		msg := NewMessage(2020, []byte(fmt.Sprintf("Hello%v", i)))
+		buf = append(buf, msg.Pack()...)
+	}
+
+	if _, err = client.Write(buf); err != nil {
+		t.Fatal(err)
+	}
+
+	// The left messages are never read if the server waits for the next edge.
+	client.SetReadDeadline(time.Now().Add(5 * time.Second))
+	for i := 0; i < count; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatalf("Received %v responses: %v", i, err)
+		}
+
+		if rsp.Code != 2020 || string(rsp.Data) != "Ayou" {
+			t.Fatalf("Unexpected response: %v", rsp)
+		}
+	}
+}
+
+func TestInlineRouter(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// The inline router echoes the data in the I/O thread.
+	const count = 100
+	buf := []byte{}
+	for i := 0; i < count; i++ {
+		msg := NewMessage(2021, []byte(fmt.Sprintf("Hello%v", i)))
+		buf = append(buf, msg.Pack()...)
+	}
+
+	if _, err = client.Write(buf); err != nil {
+		t.Fatal(err)
+	}
+
+	for i := 0; i < count; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+
+		if string(rsp.Data) != fmt.Sprintf("Hello%v", i) {
+			t.Fatal(i, rsp)
+		}
+	}
+}
+
+func TestAsyncRouter(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// The async router responds three times later.
+	if _, err = client.Write(NewMessage(2022, []byte("Hello")).Pack()); err != nil {
+		t.Fatal(err)
+	}
+
+	for i := 1; i <= 3; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+
+		if string(rsp.Data) != fmt.Sprintf("Hello%v", i) {
+			t.Fatal(i, rsp)
+		}
+	}
+}
+
+func TestSlowReader(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// The responses are much more than the socket buffer. None of them should be lost. The
+	// inline echo router responds in order.
+	const count = 50000
+	buf := []byte{}
+	for i := 0; i < count; i++ {
+		msg := NewMessage(2021, []byte(fmt.Sprintf("Hello%v", i)))
+		buf = append(buf, msg.Pack()...)
+	}
+
+	// The server pauses reading the requests at the watermarks if the responses are not read, so
+	// the requests are written concurrently with reading the responses.
+	written := make(chan error, 1)
+	go func() {
+		_, err := client.Write(buf)
+		written <- err
+	}()
+
+	for i := 0; i < count; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(i, err)
+		}
+
+		if string(rsp.Data) != fmt.Sprintf("Hello%v", i) {
+			t.Fatal(i, string(rsp.Data))
+		}
+	}
+
+	if err = <-written; err != nil {
+		t.Fatal(err)
+	}
+}
+
+func TestPartialMessage(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// Send two messages byte by byte. The header and the body are received by many reads. The
+	// pause only spreads the bytes over the reads, and the result doesn't depend on it.
+	buf := NewMessage(2020, []byte("Hello")).Pack()
+	buf = append(buf, NewMessage(2020, []byte("World")).Pack()...)
+	for _, b := range buf {
+		if _, err = client.Write([]byte{b}); err != nil {
+			t.Fatal(err)
+		}
+		time.Sleep(time.Millisecond)
+	}
+
+	for i := 0; i < 2; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+	}
+}
+
+func TestProtocolV2(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// A request of three chunks to the inline echo router, and a v1 message on the same
+	// connection. Every chunk is delivered and responded.
+	buf := NewMessageV2(2021, 42, FlagMore, []byte("Hello")).Pack()
+	buf = append(buf, NewMessageV2(2021, 42, FlagMore, []byte("Chunked")).Pack()...)
+	buf = append(buf, NewMessageV2(2021, 42, 0, []byte("World")).Pack()...)
+	buf = append(buf, NewMessage(2021, []byte("V1")).Pack()...)
+	if _, err = client.Write(buf); err != nil {
+		t.Fatal(err)
+	}
+
+	expected := []string{"Hello", "Chunked", "World"}
+	for i, data := range expected {
+		rsp := MessageV2{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+
+		more := i+1 < len(expected)
+		if string(rsp.Data) != data || rsp.RequestId != 42 || (rsp.Flags&FlagMore != 0) != more {
+			t.Fatal(i, rsp)
+		}
+	}
+
+	rsp := Message{}
+	if err = rsp.Unpack(client); err != nil {
+		t.Fatal(err)
+	}
+
+	if string(rsp.Data) != "V1" {
+		t.Fatal(rsp)
+	}
+}
+
+func TestProtocolV2LargeResponse(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// The response much larger than 64 KiB is received as chunks.
+	const size = 1000000
+	if _, err = client.Write(NewMessageV2(2023, 7, 0, []byte(fmt.Sprint(size))).Pack()); err != nil {
+		t.Fatal(err)
+	}
+
+	received := 0
+	for {
+		rsp := MessageV2{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+
+		if rsp.RequestId != 7 {
+			t.Fatal(rsp)
+		}
+
+		received += len(rsp.Data)
+		if rsp.Flags&FlagMore == 0 {
+			break
+		}
+	}
+
+	if received != size {
+		t.Fatal(received)
+	}
+}
+
+func TestProtocolV1TooLong(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// 65535 would be read as the magic of v2. The longer response is replaced by an empty one
+	// with the reserved code, and the following requests are still responded.
+	buf := NewMessage(2023, []byte("65534")).Pack()
+	buf = append(buf, NewMessage(2023, []byte("65535")).Pack()...)
+	buf = append(buf, NewMessage(2020, []byte("Hi")).Pack()...)
+	if _, err = client.Write(buf); err != nil {
+		t.Fatal(err)
+	}
+
+	// The requests are handled concurrently, so the responses are matched by code.
+	expected := map[uint16]int{2023: 65534, CodeTooLong: 0, 2020: 4}
+	for i := 0; i < 3; i++ {
+		rsp := Message{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+
+		size, ok := expected[rsp.Code]
+		if !ok || len(rsp.Data) != size {
+			t.Fatal(rsp.Code, len(rsp.Data))
+		}
+		delete(expected, rsp.Code)
+	}
+}
+
+func TestCompression(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// A compressed request to the echo router. The client accepts compression, so the echoed
+	// response is compressed too.
+	data := []byte(strings.Repeat("{\"name\":\"Hello\",\"value\":1},", 100))
+	req := NewMessageV2(2021, 1, FlagCompressed|FlagAcceptCompression, CompressChunk(data))
+	// A large response is compressed chunk by chunk.
+	buf := append(req.Pack(), NewMessageV2(2023, 2, 0, []byte("100000")).Pack()...)
+	if _, err = client.Write(buf); err != nil {
+		t.Fatal(err)
+	}
+
+	received := map[uint64][]byte{}
+	for finished := 0; finished < 2; {
+		rsp := MessageV2{}
+		if err = rsp.Unpack(client); err != nil {
+			t.Fatal(err)
+		}
+
+		if rsp.Flags&FlagCompressed == 0 {
+			t.Fatal(rsp)
+		}
+
+		chunk, err := DecompressChunk(rsp.Data)
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		received[rsp.RequestId] = append(received[rsp.RequestId], chunk...)
+		if rsp.Flags&FlagMore == 0 {
+			finished++
+		}
+	}
+
+	if string(received[1]) != string(data) || string(received[2]) != strings.Repeat("a", 100000) {
+		t.Fatal(len(received[1]), len(received[2]))
+	}
+}
+
+func TestFileRouter(t *testing.T) {
+	client, err := net.Dial("tcp4", "127.0.0.1:9005")
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	// The config file is sended by sendfile after the header.
+	if _, err = client.Write(NewMessage(2024, nil).Pack()); err != nil {
+		t.Fatal(err)
+	}
+
+	file := Message{}
+	if err = file.Unpack(client); err != nil {
+		t.Fatal(err)
+	}
+
+	if !strings.HasPrefix(string(file.Data), "{") {
+		t.Fatal(file)
+	}
+
+	if _, err = client.Write(NewMessageV2(2024, 3, 0, nil).Pack()); err != nil {
+		t.Fatal(err)
+	}
+
+	fileV2 := MessageV2{}
+	if err = fileV2.Unpack(client); err != nil {
+		t.Fatal(err)
+	}
+
+	if fileV2.RequestId != 3 || string(fileV2.Data) != string(file.Data) {
+		t.Fatal(fileV2)
+	}
+}